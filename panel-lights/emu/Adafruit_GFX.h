@@ -0,0 +1,8 @@
+// Mock Adafruit_GFX.h for the host emulator, see Adafruit_SSD1351.h.
+
+#ifndef ADAFRUIT_GFX_H
+#define ADAFRUIT_GFX_H
+
+#include "Arduino.h"
+
+#endif // ADAFRUIT_GFX_H
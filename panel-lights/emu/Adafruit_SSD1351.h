@@ -0,0 +1,33 @@
+// Mock Adafruit_SSD1351.h for the host emulator. Drawing costs the time the
+// pixels take over SPI; text is kept per 10 pixel line for the screen dump.
+
+#ifndef ADAFRUIT_SSD1351_H
+#define ADAFRUIT_SSD1351_H
+
+#include "Arduino.h"
+#include "SPI.h"
+
+#define OLED_LINES      13
+#define OLED_COLUMNS    22
+
+class Adafruit_SSD1351 {
+public:
+    Adafruit_SSD1351(uint16_t width, uint16_t height, SPIClass *spi, int8_t cs, int8_t dc, int8_t rst);
+    void begin(void);
+    void fillRect(int16_t x, int16_t y, int16_t w, int16_t h, uint16_t color);
+    void setCursor(int16_t x, int16_t y);
+    void setTextColor(uint16_t color);
+    void setTextColor(uint16_t color, uint16_t bgcolor);
+    size_t print(const char *text);
+
+    // text shown on the display, one string per 10 pixel line
+    char lines[OLED_LINES][OLED_COLUMNS + 1];
+
+private:
+    uint16_t width;
+    uint16_t height;
+    int16_t cursorX;
+    int16_t cursorY;
+};
+
+#endif // ADAFRUIT_SSD1351_H
@@ -0,0 +1,139 @@
+// Mock Arduino core for the host emulator, see hal.cpp.
+//
+// Only what panel-lights.ino uses is provided. Time is virtual: it advances
+// by a rough cost for every HAL call and jumps ahead in delay() and
+// sleep_mode(). Timers 0 and 1 and their interrupts are emulated so that
+// interrupts pend while they are disabled, as on the ATmega328P.
+
+#ifndef ARDUINO_H
+#define ARDUINO_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <string>
+
+#define HIGH            1
+#define LOW             0
+#define INPUT           0
+#define OUTPUT          1
+#define CHANGE          1
+#define DEC             10
+#define HEX             16
+
+#define LED_BUILTIN     13
+#define A0              14
+#define NUM_PINS        20
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int digitalRead(uint8_t pin);
+
+#define digitalPinToInterrupt(pin)  ((pin) == 2 ? 0 : ((pin) == 3 ? 1 : -1))
+#define digitalPinToPort(pin)       ((pin) < 8 ? 4 : ((pin) < 14 ? 2 : 3))
+#define digitalPinToBitMask(pin)    ((uint8_t)(1 << ((pin) < 8 ? (pin) : ((pin) < 14 ? (pin) - 8 : (pin) - 14))))
+volatile uint8_t *portOutputRegister(uint8_t port);
+void attachInterrupt(int8_t interrupt, void (*fn)(void), int mode);
+
+unsigned long millis(void);
+unsigned long micros(void);
+void delay(unsigned long ms);
+
+// interrupts
+#define _BV(bit)        (1 << (bit))
+void cli(void);
+void sei(void);
+
+// status register, only the I bit is emulated
+struct EmuSREG {
+    operator uint8_t() const;
+    EmuSREG &operator=(uint8_t value);
+};
+extern EmuSREG SREG;
+
+#define ISR(vector)     extern "C" void vector(void); extern "C" void vector(void)
+#define TIMER1_OVF_vect     emuTimer1OverflowISR
+#define TIMER1_COMPA_vect   emuTimer1CompareAISR
+
+// timer 1, normal mode only
+#define CS10            0
+#define CS11            1
+#define CS12            2
+#define TOV1            0
+#define OCF1A           1
+#define TOIE1           0
+#define OCIE1A          1
+
+struct EmuTCNT1 {
+    operator uint16_t() const;
+    EmuTCNT1 &operator=(uint16_t value);
+};
+// interrupt flags read as pending, writing 1 clears
+struct EmuTIFR1 {
+    operator uint8_t() const;
+    EmuTIFR1 &operator=(uint8_t value);
+};
+extern uint8_t TCCR1A;
+extern uint8_t TCCR1B;
+extern uint8_t TIMSK1;
+extern uint16_t OCR1A;
+extern EmuTCNT1 TCNT1;
+extern EmuTIFR1 TIFR1;
+
+// replaces the WS281X bit banging of render(); takes the time the LED data
+// takes to send with the interrupts disabled
+void emuRender(const uint8_t *rgb, uint16_t numPanels, uint16_t numLeds);
+
+class String {
+public:
+    String(const char *s = "") : str(s) {}
+    String &operator=(const char *s) {
+        str = s;
+        return *this;
+    }
+    const char *c_str() const {
+        return str.c_str();
+    }
+private:
+    std::string str;
+};
+
+class HardwareSerial {
+public:
+    void begin(unsigned long baud);
+    operator bool() const {
+        return true;
+    }
+    int available(void);
+    int read(void);
+    int availableForWrite(void);
+    size_t write(uint8_t c);
+    size_t write(const uint8_t *buf, size_t len);
+    size_t print(const char *s);
+    size_t print(const String &s);
+    size_t print(char c);
+    size_t print(int n, int base = DEC);
+    size_t print(unsigned int n, int base = DEC);
+    size_t print(long n, int base = DEC);
+    size_t print(unsigned long n, int base = DEC);
+    size_t println(void);
+    template <typename T>
+    size_t println(T value) {
+        size_t n = print(value);
+        return n + println();
+    }
+    template <typename T>
+    size_t println(T value, int base) {
+        size_t n = print(value, base);
+        return n + println();
+    }
+};
+extern HardwareSerial Serial;
+
+void setup(void);
+void loop(void);
+
+#endif // ARDUINO_H
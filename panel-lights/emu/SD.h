@@ -0,0 +1,49 @@
+// Mock SD.h for the host emulator. The card is a local directory; files are
+// read into memory on open. Reads cost the time of the SD blocks they touch
+// (one block cache, as in the SD library) and directory walks the time of
+// the directory blocks. Names are returned in upper case as 8.3 names are.
+
+#ifndef SD_H
+#define SD_H
+
+#include <memory>
+#include <vector>
+#include <string>
+
+#include "Arduino.h"
+
+#define FILE_READ       0
+
+struct EmuFile;
+
+class File {
+public:
+    File() {}
+    File(std::shared_ptr<EmuFile> file_) : file(file_) {}
+    operator bool() const;
+    int read(void);
+    int read(void *buf, uint16_t len);
+    int peek(void);
+    int available(void);
+    bool seek(uint32_t pos);
+    uint32_t position(void);
+    uint32_t size(void);
+    size_t readBytesUntil(char terminator, char *buffer, size_t length);
+    char *name(void);
+    bool isDirectory(void);
+    File openNextFile(uint8_t mode = FILE_READ);
+    void rewindDirectory(void);
+    void close(void);
+
+private:
+    std::shared_ptr<EmuFile> file;
+};
+
+class SDClass {
+public:
+    bool begin(uint8_t csPin);
+    File open(const char *path, uint8_t mode = FILE_READ);
+};
+extern SDClass SD;
+
+#endif // SD_H
@@ -0,0 +1,12 @@
+// Mock SPI.h for the host emulator.
+
+#ifndef SPI_H
+#define SPI_H
+
+#include "Arduino.h"
+
+class SPIClass {
+};
+extern SPIClass SPI;
+
+#endif // SPI_H
@@ -0,0 +1,12 @@
+// Mock avr/sleep.h for the host emulator. sleep_mode() jumps ahead in
+// virtual time to the next interrupt.
+
+#ifndef AVR_SLEEP_H
+#define AVR_SLEEP_H
+
+#define SLEEP_MODE_IDLE     0
+
+void set_sleep_mode(uint8_t mode);
+void sleep_mode(void);
+
+#endif // AVR_SLEEP_H
@@ -0,0 +1,167 @@
+// Host emulator of the panel lights sketch
+//
+// Runs setup() and loop() of panel-lights.ino against the mock HAL on
+// virtual time, much faster than real time. The SD card is a local
+// directory, input (encoder, button, Serial) comes from a script. At the end
+// the step timing, SD card, Serial and display statistics are reported.
+//
+// Usage: panel-emu [options] <card directory>
+//
+//   -t <s>       virtual time to run, default 60
+//   -e <script>  input script, default "2500 press" (start the selected file)
+//   -x <file>    input script from a file, see emuParseScript()
+//   -o <file>    write the Serial output to a file, for seqtelemetry
+//   -j <ms>      fail when a step is off its ideal time by more than this
+//   -s <ms>      fail when a loop() pass takes longer than this
+//   -v           echo the Serial text and display updates
+//
+// Step jitter is measured from the sketch telemetry frames (telemetry level
+// 2, the default) against the ideal schedule of the step durations.
+
+#include <unistd.h>
+#include <chrono>
+
+#include "Arduino.h"
+#include "emu.h"
+
+static bool readScriptFile(const char *path, std::string *script)
+{
+    FILE *fp = fopen(path, "r");
+    if (fp == NULL) {
+        fprintf(stderr, "failed to open script %s\n", path);
+        return false;
+    }
+    char buf[256];
+    while (fgets(buf, sizeof(buf), fp))
+        script->append(buf);
+    fclose(fp);
+    return true;
+}
+
+static double ms(double cycles)
+{
+    return cycles / EMU_CYCLES_PER_MS;
+}
+
+static void report(double seconds, double hostSeconds)
+{
+    const EmuStats &s = emuStats;
+    printf("virtual time %.3f s, host time %.3f s (%.0fx real time)\n",
+           seconds, hostSeconds, hostSeconds > 0 ? seconds / hostSeconds : 0.0);
+    printf("loop: %llu passes, longest %.3f ms at %.3f s, %llu over %.3f ms, slept %.1f %%\n",
+           (unsigned long long)s.loops, ms(s.loopMax), ms(s.loopMaxAt) / 1000,
+           (unsigned long long)s.stalls, ms(s.stallLimit), 100.0 * s.sleepCycles / emuNow());
+    printf("steps: %llu shown, %llu loops, %llu underruns, %llu gaps in telemetry\n",
+           (unsigned long long)s.steps, (unsigned long long)s.loopsShown,
+           (unsigned long long)s.underruns, (unsigned long long)s.stepGaps);
+    printf("jitter: max %+.3f ms, mean %.3f ms, %llu over %.3f ms\n",
+           ms(s.jitterMax), s.jitterCount ? ms(s.jitterAbsSum / s.jitterCount) : 0.0,
+           (unsigned long long)s.jitterOver, ms(s.jitterLimit));
+    printf("render: %llu calls, %.3f ms with interrupts disabled each\n",
+           (unsigned long long)s.renders, s.renders ? ms(s.renderCycles / s.renders) : 0.0);
+    printf("sd: %llu opens, %llu blocks, %llu bytes, %.3f ms total, longest call %.3f ms\n",
+           (unsigned long long)s.sdOpens, (unsigned long long)s.sdBlocks, (unsigned long long)s.sdBytes,
+           ms(s.sdCycles), ms(s.sdCallMax));
+    printf("serial: %llu bytes, blocked %.3f ms\n",
+           (unsigned long long)s.serialBytes, ms(s.serialBlockedCycles));
+    printf("oled: %.3f ms drawing\n", ms(s.oledCycles));
+    printf("millis(): %lu ms at %.0f ms virtual time\n", emuMillis(), ms(emuNow()));
+}
+
+int main(int argc, char **argv)
+{
+    double seconds = 60;
+    std::string script = "2500 press";
+    const char *capturePath = NULL;
+    double jitterLimit = 0;
+    double stallLimit = 0;
+    int opt;
+    while ((opt = getopt(argc, argv, "t:e:x:o:j:s:v")) != -1) {
+        switch (opt) {
+        case 't':
+            seconds = atof(optarg);
+            break;
+        case 'e':
+            script = optarg;
+            break;
+        case 'x':
+            script.clear();
+            if (! readScriptFile(optarg, &script))
+                return 1;
+            break;
+        case 'o':
+            capturePath = optarg;
+            break;
+        case 'j':
+            jitterLimit = atof(optarg);
+            break;
+        case 's':
+            stallLimit = atof(optarg);
+            break;
+        case 'v':
+            emuVerbose = 1;
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-t s] [-e script] [-x script file] [-o capture] [-j ms] [-s ms] [-v] <card directory>\n", argv[0]);
+            return 1;
+        }
+    }
+    if (optind != argc - 1) {
+        fprintf(stderr, "usage: %s [-t s] [-e script] [-x script file] [-o capture] [-j ms] [-s ms] [-v] <card directory>\n", argv[0]);
+        return 1;
+    }
+    if (access(argv[optind], R_OK) != 0) {
+        // the sketch waits forever when the card fails
+        fprintf(stderr, "card directory %s not found\n", argv[optind]);
+        return 1;
+    }
+    emuSetCard(argv[optind]);
+
+    std::vector<EmuInput> inputs;
+    if (! emuParseScript(script.c_str(), &inputs))
+        return 1;
+    // the switch is pulled up, inputs only change it
+    EmuInput released;
+    released.time = 0;
+    released.type = EMU_INPUT_BUTTON;
+    released.arg = HIGH;
+    inputs.insert(inputs.begin(), released);
+    emuSetInputs(inputs);
+    emuAdvance(1);
+
+    if (capturePath) {
+        emuCapture = fopen(capturePath, "wb");
+        if (emuCapture == NULL) {
+            fprintf(stderr, "failed to open %s\n", capturePath);
+            return 1;
+        }
+    }
+    emuStats.jitterLimit = jitterLimit * EMU_CYCLES_PER_MS;
+    emuStats.stallLimit = stallLimit * EMU_CYCLES_PER_MS;
+
+    auto hostStart = std::chrono::steady_clock::now();
+    setup();
+    uint64_t end = (uint64_t)(seconds * EMU_CPU_HZ);
+    while (emuNow() < end) {
+        uint64_t start = emuNow();
+        uint64_t slept = emuStats.sleepCycles;
+        loop();
+        emuAdvance(EMU_LOOP_CYCLES);
+        uint64_t busy = (emuNow() - start) - (emuStats.sleepCycles - slept);
+        emuStats.loops++;
+        if (busy > emuStats.loopMax) {
+            emuStats.loopMax = busy;
+            emuStats.loopMaxAt = start;
+        }
+        if (stallLimit > 0 && busy > emuStats.stallLimit)
+            emuStats.stalls++;
+    }
+    double hostSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - hostStart).count();
+    if (emuCapture)
+        fclose(emuCapture);
+
+    report(emuNow() / (double)EMU_CPU_HZ, hostSeconds);
+    bool failed = (jitterLimit > 0 && emuStats.jitterOver > 0) ||
+                  (stallLimit > 0 && emuStats.stalls > 0);
+    return failed ? 1 : 0;
+}
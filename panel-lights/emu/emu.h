@@ -0,0 +1,105 @@
+// Host emulator state shared by the mock HAL (hal.cpp) and the emulator
+// driver (emu.cpp).
+
+#ifndef EMU_H
+#define EMU_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+// virtual time unit is one CPU cycle at 16 MHz
+#define EMU_CPU_HZ              16000000ULL
+#define EMU_CYCLES_PER_US       16
+#define EMU_CYCLES_PER_MS       16000
+
+// Cost model, rough figures for an ATmega328P at 16 MHz. Code between HAL
+// calls is free, every HAL call costs a little so that busy waits end.
+#define EMU_PIN_CYCLES          60          // digitalRead(), digitalWrite()
+#define EMU_TIME_CYCLES         60          // millis(), micros()
+#define EMU_LOOP_CYCLES         32          // one loop() pass without calls
+#define EMU_ISR_CYCLES          80          // interrupt entry and exit
+#define EMU_LED_BIT_CYCLES      20          // WS281X bit, 1.25 us
+#define EMU_SD_CALL_CYCLES      80          // File call overhead
+#define EMU_SD_BYTE_CYCLES      8           // copy from the block cache
+#define EMU_SD_BLOCK_CYCLES     20800       // 512 byte block over SPI, 1.3 ms
+#define EMU_SD_OPEN_CYCLES      32000       // directory search, 2 ms
+#define EMU_SD_DIR_ENTRIES      16          // 32 byte entries per block
+#define EMU_OLED_CALL_CYCLES    320         // command and window setup
+#define EMU_OLED_PIXEL_CYCLES   32          // 2 bytes at 8 MHz SPI
+#define EMU_OLED_CHAR_CYCLES    6144        // 6x8 glyph pixel by pixel
+#define EMU_SERIAL_BAUD         115200
+#define EMU_SERIAL_TX_BUFFER    64
+#define EMU_SERIAL_WRITE_CYCLES 80          // HardwareSerial::write()
+
+// scripted input, see emuParseScript()
+enum {
+    EMU_INPUT_CW = 1,                       // one encoder detent clockwise
+    EMU_INPUT_CCW,                          // and counter clockwise
+    EMU_INPUT_BUTTON,                       // switch level, arg 0 = pressed
+    EMU_INPUT_SERIAL,                       // characters received
+};
+
+struct EmuInput {
+    uint64_t time;                          // cycles
+    int type;
+    int arg;
+    std::string text;
+};
+
+struct EmuStats {
+    // loop() passes, time in them not counting sleep
+    uint64_t loops;
+    uint64_t loopMax;
+    uint64_t loopMaxAt;
+    uint64_t stalls;                        // passes over the stall limit
+    uint64_t stallLimit;
+    uint64_t sleepCycles;
+    // render()
+    uint64_t renders;
+    uint64_t renderCycles;
+    // SD card
+    uint64_t sdBlocks;
+    uint64_t sdBytes;
+    uint64_t sdCycles;
+    uint64_t sdCallMax;
+    uint64_t sdOpens;
+    // OLED
+    uint64_t oledCycles;
+    // Serial
+    uint64_t serialBytes;
+    uint64_t serialBlockedCycles;
+    // steps, from the sketch telemetry frames
+    uint64_t steps;
+    uint64_t stepGaps;
+    uint64_t underruns;
+    uint64_t loopsShown;
+    int64_t jitterMax;                      // cycles, largest absolute value
+    double jitterAbsSum;
+    uint64_t jitterCount;
+    uint64_t jitterOver;                    // steps over the jitter limit
+    uint64_t jitterLimit;
+};
+
+extern EmuStats emuStats;
+// echo the Serial text and the display updates
+extern int emuVerbose;
+// Serial output is also written here, for seqtelemetry
+extern FILE *emuCapture;
+
+uint64_t emuNow(void);
+// let virtual time pass, handling the timer and scripted input events
+void emuAdvance(uint64_t cycles);
+void emuAdvanceTo(uint64_t time);
+
+// directory that backs the SD card
+void emuSetCard(const char *path);
+bool emuParseScript(const char *script, std::vector<EmuInput> *inputs);
+void emuSetInputs(const std::vector<EmuInput> &inputs);
+
+// millis() as the sketch sees it, can fall behind virtual time when the
+// timer 0 overflow interrupts are lost while interrupts are disabled
+unsigned long emuMillis(void);
+
+#endif // EMU_H
@@ -0,0 +1,901 @@
+// Mock Arduino HAL for the host emulator.
+//
+// Virtual time is counted in CPU cycles and only moves in HAL calls. Timer 0
+// (millis(), micros()) and timer 1 are derived from it; their overflow and
+// compare match interrupts, the external encoder interrupt and the scripted
+// input are events on the way. An event sets the interrupt flag and the
+// interrupt is handled at once when interrupts are enabled, or later on
+// sei(). As on the hardware a flag is set only once, so overflows that fall
+// in one long interrupts disabled window are lost.
+
+#include <dirent.h>
+#include <ctype.h>
+#include <deque>
+#include <algorithm>
+
+#include "Arduino.h"
+#include "SPI.h"
+#include "SD.h"
+#include "Adafruit_SSD1351.h"
+#include "avr/sleep.h"
+#include "emu.h"
+#include "../seqformat.h"
+
+EmuStats emuStats;
+int emuVerbose = 0;
+FILE *emuCapture = NULL;
+
+HardwareSerial Serial;
+SPIClass SPI;
+SDClass SD;
+EmuSREG SREG;
+
+uint8_t TCCR1A;
+uint8_t TCCR1B;
+uint8_t TIMSK1;
+uint16_t OCR1A;
+EmuTCNT1 TCNT1;
+EmuTIFR1 TIFR1;
+
+// interrupt service routines of the sketch; these do nothing when the
+// sketch does not define them
+extern "C" __attribute__((weak)) void emuTimer1OverflowISR(void) {}
+extern "C" __attribute__((weak)) void emuTimer1CompareAISR(void) {}
+
+#define TIMER0_OVERFLOW_CYCLES  (64 * 256)
+#define SERIAL_BYTE_CYCLES      ((uint64_t)(EMU_CPU_HZ * 10 / EMU_SERIAL_BAUD))
+
+static uint64_t now;
+static bool interrupts = true;
+static bool inISR;
+
+// timer 0, prescaler 64, as set up by the Arduino core
+static uint64_t timer0Next = TIMER0_OVERFLOW_CYCLES;
+static bool timer0Pending;
+static unsigned long timer0Overflows;
+static unsigned long timer0Millis;
+static uint8_t timer0Fract;
+
+// timer 1
+static uint64_t timer1Origin;       // cycles at which the count was 0
+static uint16_t timer1Stopped;      // count while no clock is selected
+static bool timer1Overflow;
+static bool timer1CompareA;
+
+// external interrupts 0 and 1
+static void (*extISR[2])(void);
+static bool extPending[2];
+
+static uint8_t pins[NUM_PINS];
+static uint8_t ports[5];
+
+static std::vector<EmuInput> inputs;
+static size_t nextInput;
+
+static uint64_t serialTxDone;       // all queued bytes are out at this time
+static std::deque<uint8_t> serialRx;
+// Serial bytes of a telemetry frame being received
+static uint8_t frameBuf[sizeof(SeqtFrame)];
+static size_t frameLen;
+
+uint64_t emuNow(void)
+{
+    return now;
+}
+
+static int timer1Prescaler(void)
+{
+    static const int prescalers[8] = { 0, 1, 8, 64, 256, 1024, 0, 0 };
+    return prescalers[TCCR1B & 0x07];
+}
+
+static uint64_t timer1Count(void)
+{
+    int prescaler = timer1Prescaler();
+    if (prescaler == 0)
+        return timer1Stopped;
+    return (now - timer1Origin) / prescaler;
+}
+
+// time of the first timer 1 count after the current one where the low 16
+// bits equal value; UINT64_MAX if the timer is stopped
+static uint64_t timer1Next(uint16_t value)
+{
+    int prescaler = timer1Prescaler();
+    if (prescaler == 0)
+        return UINT64_MAX;
+    uint64_t count = timer1Count() + 1;
+    count += (uint16_t)(value - (uint16_t)count);
+    return timer1Origin + count * prescaler;
+}
+
+static void dispatch(void)
+{
+    if (! interrupts || inISR)
+        return;
+    inISR = true;
+    interrupts = false;
+    while (true) {
+        if (extPending[0] || extPending[1]) {
+            int n = extPending[0] ? 0 : 1;
+            extPending[n] = false;
+            if (extISR[n])
+                extISR[n]();
+        } else if (timer1CompareA && (TIMSK1 & _BV(OCIE1A))) {
+            timer1CompareA = false;
+            emuTimer1CompareAISR();
+        } else if (timer1Overflow && (TIMSK1 & _BV(TOIE1))) {
+            timer1Overflow = false;
+            emuTimer1OverflowISR();
+        } else if (timer0Pending) {
+            // millis() bookkeeping of the Arduino core
+            timer0Pending = false;
+            timer0Overflows++;
+            timer0Millis++;
+            timer0Fract += 3;
+            if (timer0Fract >= 125) {
+                timer0Fract -= 125;
+                timer0Millis++;
+            }
+        } else {
+            break;
+        }
+        // interrupts stay disabled, events on the way only set flags
+        emuAdvance(EMU_ISR_CYCLES);
+    }
+    interrupts = true;
+    inISR = false;
+}
+
+static void applyInput(const EmuInput &input)
+{
+    switch (input.type) {
+    case EMU_INPUT_CW:
+    case EMU_INPUT_CCW:
+        // one detent is one CLK (pin 2) edge; DT (pin 3) tells the direction
+        pins[2] = ! pins[2];
+        pins[3] = (input.type == EMU_INPUT_CW) ? pins[2] : ! pins[2];
+        extPending[0] = true;
+        break;
+    case EMU_INPUT_BUTTON:
+        pins[A0] = input.arg;
+        break;
+    case EMU_INPUT_SERIAL:
+        serialRx.insert(serialRx.end(), input.text.begin(), input.text.end());
+        break;
+    }
+}
+
+void emuAdvanceTo(uint64_t time)
+{
+    while (now < time) {
+        uint64_t next = time;
+        next = std::min(next, timer0Next);
+        uint64_t ovf1 = timer1Next(0);
+        uint64_t cmp1 = timer1Next(OCR1A);
+        next = std::min(next, std::min(ovf1, cmp1));
+        if (nextInput < inputs.size())
+            next = std::min(next, std::max(now, inputs[nextInput].time));
+        now = next;
+
+        if (now == timer0Next) {
+            timer0Pending = true;
+            timer0Next += TIMER0_OVERFLOW_CYCLES;
+        }
+        if (now == ovf1)
+            timer1Overflow = true;
+        if (now == cmp1)
+            timer1CompareA = true;
+        while (nextInput < inputs.size() && inputs[nextInput].time <= now)
+            applyInput(inputs[nextInput++]);
+        dispatch();
+    }
+}
+
+void emuAdvance(uint64_t cycles)
+{
+    emuAdvanceTo(now + cycles);
+}
+
+unsigned long emuMillis(void)
+{
+    return timer0Millis;
+}
+
+void emuSetInputs(const std::vector<EmuInput> &inputs_)
+{
+    inputs = inputs_;
+    std::stable_sort(inputs.begin(), inputs.end(),
+                     [](const EmuInput &a, const EmuInput &b) { return a.time < b.time; });
+    nextInput = 0;
+}
+
+// Script: one input per line or ';', "<time in ms> <command> [argument]".
+// Commands: cw [n], ccw [n] turn the encoder n detents 50 ms apart; press
+// presses the button for 100 ms; serial <text> sends text to the sketch.
+bool emuParseScript(const char *script, std::vector<EmuInput> *result)
+{
+    std::string text(script);
+    std::replace(text.begin(), text.end(), ';', '\n');
+    size_t pos = 0;
+    while (pos < text.size()) {
+        size_t end = text.find('\n', pos);
+        if (end == std::string::npos)
+            end = text.size();
+        std::string line = text.substr(pos, end - pos);
+        pos = end + 1;
+
+        char command[16] = "";
+        double ms;
+        int offset = 0;
+        if (sscanf(line.c_str(), " %lf %15s %n", &ms, command, &offset) < 2) {
+            if (line.find_first_not_of(" \t\r") != std::string::npos && line[line.find_first_not_of(" \t\r")] != '#') {
+                fprintf(stderr, "bad script line '%s'\n", line.c_str());
+                return false;
+            }
+            continue;
+        }
+        const char *arg = line.c_str() + offset;
+        EmuInput input;
+        input.time = (uint64_t)(ms * EMU_CYCLES_PER_MS);
+        input.arg = 0;
+        if (strcmp(command, "cw") == 0 || strcmp(command, "ccw") == 0) {
+            int count = (*arg) ? atoi(arg) : 1;
+            input.type = (strcmp(command, "cw") == 0) ? EMU_INPUT_CW : EMU_INPUT_CCW;
+            for (int n = 0; n < count; n++) {
+                result->push_back(input);
+                input.time += 50 * EMU_CYCLES_PER_MS;
+            }
+        } else if (strcmp(command, "press") == 0) {
+            input.type = EMU_INPUT_BUTTON;
+            input.arg = LOW;
+            result->push_back(input);
+            input.time += 100 * EMU_CYCLES_PER_MS;
+            input.arg = HIGH;
+            result->push_back(input);
+        } else if (strcmp(command, "serial") == 0) {
+            input.type = EMU_INPUT_SERIAL;
+            input.text = arg;
+            result->push_back(input);
+        } else {
+            fprintf(stderr, "unknown script command '%s'\n", command);
+            return false;
+        }
+    }
+    return true;
+}
+
+// digital pins
+
+void pinMode(uint8_t pin, uint8_t mode)
+{
+    (void)pin;
+    (void)mode;
+}
+
+void digitalWrite(uint8_t pin, uint8_t value)
+{
+    emuAdvance(EMU_PIN_CYCLES);
+    if (pin < NUM_PINS)
+        pins[pin] = value ? HIGH : LOW;
+}
+
+int digitalRead(uint8_t pin)
+{
+    emuAdvance(EMU_PIN_CYCLES);
+    return (pin < NUM_PINS) ? pins[pin] : LOW;
+}
+
+volatile uint8_t *portOutputRegister(uint8_t port)
+{
+    return &ports[port < 5 ? port : 0];
+}
+
+void attachInterrupt(int8_t interrupt, void (*fn)(void), int mode)
+{
+    (void)mode;
+    if (interrupt == 0 || interrupt == 1)
+        extISR[interrupt] = fn;
+}
+
+// time
+
+unsigned long millis(void)
+{
+    emuAdvance(EMU_TIME_CYCLES);
+    return timer0Millis;
+}
+
+unsigned long micros(void)
+{
+    emuAdvance(EMU_TIME_CYCLES);
+    unsigned long m = timer0Overflows;
+    uint8_t t = (now / 64) & 0xFF;
+    if (timer0Pending && t < 255)
+        m++;
+    return ((m << 8) + t) * 4;
+}
+
+void delay(unsigned long ms)
+{
+    emuAdvance((uint64_t)ms * EMU_CYCLES_PER_MS);
+}
+
+// interrupts and timer 1 registers
+
+void cli(void)
+{
+    interrupts = false;
+}
+
+void sei(void)
+{
+    interrupts = true;
+    dispatch();
+}
+
+EmuSREG::operator uint8_t() const
+{
+    return interrupts ? 0x80 : 0x00;
+}
+
+EmuSREG &EmuSREG::operator=(uint8_t value)
+{
+    interrupts = (value & 0x80) != 0;
+    dispatch();
+    return *this;
+}
+
+EmuTCNT1::operator uint16_t() const
+{
+    return (uint16_t)timer1Count();
+}
+
+EmuTCNT1 &EmuTCNT1::operator=(uint16_t value)
+{
+    int prescaler = timer1Prescaler();
+    if (prescaler == 0)
+        timer1Stopped = value;
+    else
+        timer1Origin = now - (uint64_t)value * prescaler;
+    return *this;
+}
+
+EmuTIFR1::operator uint8_t() const
+{
+    return (timer1Overflow ? _BV(TOV1) : 0) | (timer1CompareA ? _BV(OCF1A) : 0);
+}
+
+EmuTIFR1 &EmuTIFR1::operator=(uint8_t value)
+{
+    if (value & _BV(TOV1))
+        timer1Overflow = false;
+    if (value & _BV(OCF1A))
+        timer1CompareA = false;
+    return *this;
+}
+
+void set_sleep_mode(uint8_t mode)
+{
+    (void)mode;
+}
+
+// Idle sleep until the next interrupt: timer 0 overflow, enabled timer 1
+// interrupts, Serial transmit and the scripted input.
+void sleep_mode(void)
+{
+    uint64_t wake = timer0Next;
+    if (TIMSK1 & _BV(TOIE1))
+        wake = std::min(wake, timer1Next(0));
+    if (TIMSK1 & _BV(OCIE1A))
+        wake = std::min(wake, timer1Next(OCR1A));
+    if (serialTxDone > now)
+        wake = std::min(wake, now + (serialTxDone - now - 1) % SERIAL_BYTE_CYCLES + 1);
+    if (nextInput < inputs.size())
+        wake = std::min(wake, std::max(now, inputs[nextInput].time));
+    uint64_t start = now;
+    emuAdvanceTo(wake);
+    emuStats.sleepCycles += now - start;
+}
+
+void emuRender(const uint8_t *rgb, uint16_t numPanels, uint16_t numLeds)
+{
+    (void)rgb;
+    uint64_t cycles = (uint64_t)numPanels * numLeds * 24 * EMU_LED_BIT_CYCLES;
+    emuAdvance(cycles);
+    emuStats.renders++;
+    emuStats.renderCycles += cycles;
+}
+
+// Serial
+
+static void handleFrame(const SeqtFrame &frame)
+{
+    // ideal time of the next step, on the time base of the frames
+    static bool haveNext;
+    static uint32_t nextTime;
+    static uint16_t lastStep;
+
+    if (frame.type == SEQT_OPEN) {
+        haveNext = false;
+    } else if (frame.type == SEQT_UNDERRUN) {
+        emuStats.underruns++;
+    } else if (frame.type == SEQT_REWIND) {
+        emuStats.loopsShown++;
+    } else if (frame.type == SEQT_STEP) {
+        emuStats.steps++;
+        if (haveNext && (uint16_t)(frame.step - lastStep) != 1) {
+            // durations of the missing steps are not known
+            emuStats.stepGaps++;
+            haveNext = false;
+        }
+        if (haveNext) {
+            int64_t jitter = (int64_t)(int32_t)(frame.time - nextTime) * SEQT_TICK_US * EMU_CYCLES_PER_US;
+            emuStats.jitterAbsSum += llabs(jitter);
+            emuStats.jitterCount++;
+            if (llabs(jitter) > llabs(emuStats.jitterMax))
+                emuStats.jitterMax = jitter;
+            if (emuStats.jitterLimit > 0 && (uint64_t)llabs(jitter) > emuStats.jitterLimit)
+                emuStats.jitterOver++;
+            nextTime += (uint32_t)frame.duration * 100000 / SEQT_TICK_US;
+        } else {
+            nextTime = frame.time + (uint32_t)frame.duration * 100000 / SEQT_TICK_US;
+            haveNext = true;
+        }
+        lastStep = frame.step;
+    }
+}
+
+// picks the telemetry frames out of the Serial output
+static void serialOutput(uint8_t c)
+{
+    if (emuCapture)
+        fputc(c, emuCapture);
+    if (frameLen == 0 && c != SEQT_SYNC) {
+        if (emuVerbose)
+            fputc(c, stdout);
+        return;
+    }
+    frameBuf[frameLen++] = c;
+    if (frameLen < sizeof(SeqtFrame))
+        return;
+    frameLen = 0;
+    uint8_t check = 0;
+    for (size_t n = 0; n < sizeof(SeqtFrame) - 1; n++)
+        check ^= frameBuf[n];
+    if (check == frameBuf[sizeof(SeqtFrame) - 1]) {
+        SeqtFrame frame;
+        memcpy(&frame, frameBuf, sizeof(frame));
+        handleFrame(frame);
+    }
+}
+
+void HardwareSerial::begin(unsigned long baud)
+{
+    (void)baud;
+}
+
+int HardwareSerial::available(void)
+{
+    return serialRx.size();
+}
+
+int HardwareSerial::read(void)
+{
+    if (serialRx.empty())
+        return -1;
+    int c = serialRx.front();
+    serialRx.pop_front();
+    return c;
+}
+
+int HardwareSerial::availableForWrite(void)
+{
+    // one byte is in the transmit shift register
+    uint64_t queued = (serialTxDone > now) ? (serialTxDone - now + SERIAL_BYTE_CYCLES - 1) / SERIAL_BYTE_CYCLES : 0;
+    if (queued > 0)
+        queued--;
+    return EMU_SERIAL_TX_BUFFER - 1 - (int)std::min<uint64_t>(queued, EMU_SERIAL_TX_BUFFER - 1);
+}
+
+size_t HardwareSerial::write(uint8_t c)
+{
+    emuAdvance(EMU_SERIAL_WRITE_CYCLES);
+    if (availableForWrite() == 0) {
+        // buffer full, wait for a byte to go out
+        uint64_t start = now;
+        while (availableForWrite() == 0)
+            emuAdvance(SERIAL_BYTE_CYCLES / 4);
+        emuStats.serialBlockedCycles += now - start;
+    }
+    serialTxDone = std::max(serialTxDone, now) + SERIAL_BYTE_CYCLES;
+    emuStats.serialBytes++;
+    serialOutput(c);
+    return 1;
+}
+
+size_t HardwareSerial::write(const uint8_t *buf, size_t len)
+{
+    for (size_t n = 0; n < len; n++)
+        write(buf[n]);
+    return len;
+}
+
+size_t HardwareSerial::print(const char *s)
+{
+    return write((const uint8_t *)s, strlen(s));
+}
+
+size_t HardwareSerial::print(const String &s)
+{
+    return print(s.c_str());
+}
+
+size_t HardwareSerial::print(char c)
+{
+    return write((uint8_t)c);
+}
+
+size_t HardwareSerial::print(int n, int base)
+{
+    return print((long)n, base);
+}
+
+size_t HardwareSerial::print(unsigned int n, int base)
+{
+    return print((unsigned long)n, base);
+}
+
+size_t HardwareSerial::print(long n, int base)
+{
+    char buf[24];
+    snprintf(buf, sizeof(buf), (base == HEX) ? "%lX" : "%ld", n);
+    return print(buf);
+}
+
+size_t HardwareSerial::print(unsigned long n, int base)
+{
+    char buf[24];
+    snprintf(buf, sizeof(buf), (base == HEX) ? "%lX" : "%lu", n);
+    return print(buf);
+}
+
+size_t HardwareSerial::println(void)
+{
+    return print("\r\n");
+}
+
+// OLED display
+
+Adafruit_SSD1351::Adafruit_SSD1351(uint16_t width_, uint16_t height_, SPIClass *spi, int8_t cs, int8_t dc, int8_t rst)
+    : width(width_), height(height_), cursorX(0), cursorY(0)
+{
+    (void)spi;
+    (void)cs;
+    (void)dc;
+    (void)rst;
+    memset(lines, 0, sizeof(lines));
+}
+
+void Adafruit_SSD1351::begin(void)
+{
+    // reset and init sequence
+    delay(120);
+}
+
+void Adafruit_SSD1351::fillRect(int16_t x, int16_t y, int16_t w, int16_t h, uint16_t color)
+{
+    (void)color;
+    uint64_t cycles = EMU_OLED_CALL_CYCLES + (uint64_t)w * h * EMU_OLED_PIXEL_CYCLES;
+    emuAdvance(cycles);
+    emuStats.oledCycles += cycles;
+    // clear the text on the lines the rectangle covers
+    for (int line = y / 10; line < OLED_LINES && line * 10 < y + h; line++) {
+        if (line < 0)
+            continue;
+        int first = x / 6;
+        int last = std::min((x + w + 5) / 6, OLED_COLUMNS);
+        for (int col = first; col < last; col++)
+            lines[line][col] = ' ';
+        // trim
+        int len = strlen(lines[line]);
+        while (len > 0 && lines[line][len - 1] == ' ')
+            lines[line][--len] = '\0';
+    }
+}
+
+void Adafruit_SSD1351::setCursor(int16_t x, int16_t y)
+{
+    cursorX = x;
+    cursorY = y;
+}
+
+void Adafruit_SSD1351::setTextColor(uint16_t color)
+{
+    (void)color;
+}
+
+void Adafruit_SSD1351::setTextColor(uint16_t color, uint16_t bgcolor)
+{
+    (void)color;
+    (void)bgcolor;
+}
+
+size_t Adafruit_SSD1351::print(const char *text)
+{
+    size_t len = strlen(text);
+    uint64_t cycles = EMU_OLED_CALL_CYCLES + (uint64_t)len * EMU_OLED_CHAR_CYCLES;
+    emuAdvance(cycles);
+    emuStats.oledCycles += cycles;
+    int line = cursorY / 10;
+    if (line >= 0 && line < OLED_LINES) {
+        char *p = lines[line];
+        int col = cursorX / 6;
+        int cur = strlen(p);
+        while (cur < col && cur < OLED_COLUMNS)
+            p[cur++] = ' ';
+        for (size_t n = 0; n < len && col < OLED_COLUMNS; n++, col++)
+            p[col] = text[n];
+        p[std::max(cur, col)] = '\0';
+        if (emuVerbose)
+            printf("[%10.3f] oled %2d: %s\n", now / (double)EMU_CYCLES_PER_MS, line, p);
+    }
+    cursorX += len * 6;
+    return len;
+}
+
+// SD card
+
+struct EmuFile {
+    int id;                         // for the block cache
+    std::string name;               // upper case, as 8.3 names are returned
+    std::string path;
+    bool directory;
+    bool loaded;
+    std::vector<uint8_t> data;
+    uint32_t pos;
+    // directory listing, sorted by name
+    std::vector<std::string> entries;
+    size_t entry;
+};
+
+static std::string cardPath;
+static int nextFileId = 1;
+// the SD library caches a single block
+static uint64_t cachedBlock = UINT64_MAX;
+
+void emuSetCard(const char *path)
+{
+    cardPath = path;
+}
+
+static void sdCost(uint64_t start)
+{
+    uint64_t cycles = now - start;
+    emuStats.sdCycles += cycles;
+    emuStats.sdCallMax = std::max(emuStats.sdCallMax, cycles);
+}
+
+// read block of file id into the cache, if not there yet
+static void sdBlock(int id, uint32_t block)
+{
+    uint64_t key = ((uint64_t)id << 32) | block;
+    if (key == cachedBlock)
+        return;
+    cachedBlock = key;
+    emuStats.sdBlocks++;
+    emuAdvance(EMU_SD_BLOCK_CYCLES);
+}
+
+static std::shared_ptr<EmuFile> openPath(const std::string &path, const std::string &name)
+{
+    std::shared_ptr<EmuFile> file = std::make_shared<EmuFile>();
+    file->id = nextFileId++;
+    file->name = name;
+    file->path = path;
+    file->pos = 0;
+    file->entry = 0;
+    file->loaded = false;
+    DIR *dirp = opendir(path.c_str());
+    file->directory = (dirp != NULL);
+    if (dirp) {
+        struct dirent *dp;
+        while ((dp = readdir(dirp)) != NULL) {
+            if (dp->d_name[0] != '.')
+                file->entries.push_back(dp->d_name);
+        }
+        closedir(dirp);
+        std::sort(file->entries.begin(), file->entries.end());
+        return file;
+    }
+    FILE *fp = fopen(path.c_str(), "rb");
+    if (fp == NULL)
+        return NULL;
+    fclose(fp);
+    return file;
+}
+
+// contents are read from the host file on the first read
+static void loadFile(EmuFile *file)
+{
+    if (file->loaded)
+        return;
+    file->loaded = true;
+    FILE *fp = fopen(file->path.c_str(), "rb");
+    if (fp == NULL)
+        return;
+    uint8_t buf[4096];
+    size_t len;
+    while ((len = fread(buf, 1, sizeof(buf), fp)) > 0)
+        file->data.insert(file->data.end(), buf, buf + len);
+    fclose(fp);
+}
+
+static std::string upperName(const std::string &name)
+{
+    std::string upper = name.substr(0, 12);
+    for (size_t n = 0; n < upper.size(); n++)
+        upper[n] = toupper((unsigned char)upper[n]);
+    return upper;
+}
+
+bool SDClass::begin(uint8_t csPin)
+{
+    (void)csPin;
+    delay(10);
+    DIR *dirp = opendir(cardPath.c_str());
+    if (dirp)
+        closedir(dirp);
+    return dirp != NULL;
+}
+
+File SDClass::open(const char *path, uint8_t mode)
+{
+    (void)mode;
+    uint64_t start = now;
+    emuAdvance(EMU_SD_OPEN_CYCLES);
+    emuStats.sdOpens++;
+    std::shared_ptr<EmuFile> file;
+    if (strcmp(path, "/") == 0) {
+        file = openPath(cardPath, "/");
+    } else {
+        // FAT names are not case sensitive
+        const char *name = (path[0] == '/') ? path + 1 : path;
+        DIR *dirp = opendir(cardPath.c_str());
+        struct dirent *dp;
+        while (dirp && (dp = readdir(dirp)) != NULL) {
+            if (strcasecmp(dp->d_name, name) == 0) {
+                file = openPath(cardPath + "/" + dp->d_name, upperName(dp->d_name));
+                break;
+            }
+        }
+        if (dirp)
+            closedir(dirp);
+    }
+    sdCost(start);
+    return File(file);
+}
+
+File::operator bool() const
+{
+    return file != NULL;
+}
+
+int File::read(void)
+{
+    uint8_t c;
+    return (read(&c, 1) == 1) ? c : -1;
+}
+
+int File::read(void *buf, uint16_t len)
+{
+    if (! file || file->directory)
+        return -1;
+    uint64_t start = now;
+    emuAdvance(EMU_SD_CALL_CYCLES);
+    loadFile(file.get());
+    uint32_t avail = (file->pos < file->data.size()) ? file->data.size() - file->pos : 0;
+    uint32_t count = std::min<uint32_t>(len, avail);
+    for (uint32_t block = file->pos / 512; count && block <= (file->pos + count - 1) / 512; block++)
+        sdBlock(file->id, block);
+    memcpy(buf, file->data.data() + file->pos, count);
+    file->pos += count;
+    emuAdvance((uint64_t)count * EMU_SD_BYTE_CYCLES);
+    emuStats.sdBytes += count;
+    sdCost(start);
+    return count;
+}
+
+int File::peek(void)
+{
+    if (! file || file->directory)
+        return -1;
+    uint32_t pos = file->pos;
+    int c = read();
+    file->pos = pos;
+    return c;
+}
+
+int File::available(void)
+{
+    if (! file || file->directory)
+        return 0;
+    loadFile(file.get());
+    return (file->pos < file->data.size()) ? file->data.size() - file->pos : 0;
+}
+
+bool File::seek(uint32_t pos)
+{
+    if (! file || file->directory)
+        return false;
+    emuAdvance(EMU_SD_CALL_CYCLES);
+    loadFile(file.get());
+    if (pos > file->data.size())
+        return false;
+    file->pos = pos;
+    return true;
+}
+
+uint32_t File::position(void)
+{
+    return file ? file->pos : 0;
+}
+
+uint32_t File::size(void)
+{
+    if (! file || file->directory)
+        return 0;
+    loadFile(file.get());
+    return file->data.size();
+}
+
+// Stream::readBytesUntil(), one read() per character
+size_t File::readBytesUntil(char terminator, char *buffer, size_t length)
+{
+    size_t count = 0;
+    while (count < length) {
+        int c = read();
+        if (c < 0 || c == terminator)
+            break;
+        buffer[count++] = c;
+    }
+    return count;
+}
+
+char *File::name(void)
+{
+    return file ? (char *)file->name.c_str() : (char *)"";
+}
+
+bool File::isDirectory(void)
+{
+    return file && file->directory;
+}
+
+File File::openNextFile(uint8_t mode)
+{
+    (void)mode;
+    if (! file || ! file->directory)
+        return File();
+    uint64_t start = now;
+    emuAdvance(EMU_SD_CALL_CYCLES);
+    sdBlock(file->id, file->entry / EMU_SD_DIR_ENTRIES);
+    std::shared_ptr<EmuFile> next;
+    if (file->entry < file->entries.size()) {
+        const std::string &name = file->entries[file->entry++];
+        next = openPath(file->path + "/" + name, upperName(name));
+    }
+    sdCost(start);
+    return File(next);
+}
+
+void File::rewindDirectory(void)
+{
+    if (file && file->directory)
+        file->entry = 0;
+}
+
+void File::close(void)
+{
+    file = NULL;
+}
@@ -0,0 +1,5 @@
+// The sketch compiled as a C++ translation unit against the mock HAL, as the
+// Arduino IDE does with the .ino file.
+
+#include "Arduino.h"
+#include "../panel-lights.ino"
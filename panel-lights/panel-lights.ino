@@ -5,6 +5,10 @@
 #include <Adafruit_SSD1351.h>
 // include the SD library
 #include <SD.h>
+// compiled sequence file format (shared with seqtool)
+#include "seqformat.h"
+// idle sleep while waiting for the step deadline
+#include <avr/sleep.h>
 
 // Rotary Encoder
 #define inputCLK        2     // terminal B
@@ -61,8 +65,7 @@ uint8_t brightness;
 int tmpInt;
 
 uint8_t mode1, mode2;
-uint32_t color1, color2;
-uint32_t timeMillis, timeDelay;
+uint32_t timeMillis;
 char buff[32];
 size_t buffLen;
 // https://en.wikipedia.org/wiki/8.3_filename
@@ -73,22 +76,72 @@ char filenames[5][13];
 
 File root;
 int nrFiles = 0;
+// SD card index written by seqtool (see seqformat.h); when present the file
+// list is read from it instead of the directory
+File indexFile;
+uint16_t indexHeaderSize;
+// duration and short name of the selected file, from the index
+char selectedInfo[22];
+// directory walk without an index: number of files read since the last
+// rewind, and the selected file the filenames window was filled for
+uint16_t dirCursor = 0;
+int windowSelected = -1;
 File dataFile;
+// compiled sequence file opened, steps are read as fixed size records
+uint8_t fileBinary = 0;
+SeqbHeaderStart seqbHeader;
+
+// Read-ahead step buffer. Steps are read from the SD card and parsed while
+// the current step is shown, so that at the step deadline only render() is
+// left to do. Text data lines are parsed into the same record as used by
+// compiled sequences.
+#define STEP_BUFFER_SIZE  4     // power of 2
+SeqbStep stepBuffer[STEP_BUFFER_SIZE];
+uint8_t stepHead = 0;           // next slot to fill
+uint8_t stepTail = 0;           // next step to show
 
 // FSM defines
 enum {
   fsmIdle = 0,
   fsmFileSelect,
   fsmFileOpen,
-  fsmHandleNameLine,
-  fsmHandleDescriptionLine,
   fsmHandleDataLine,
   fsmSequenceRun,
   fsmSequenceStop,
 };
 
 uint8_t fsmState = fsmIdle;
-uint8_t readNextLine = 0;
+
+// Step scheduler time base. Timer 1 runs freely at 16 MHz / 256 = 62.5 kHz
+// (16 us per tick), its overflows extend the count to 32 bits. Unlike the
+// millis() timer 0 overflow interrupts, the hardware counter keeps counting
+// while render() has the interrupts disabled, so no time is lost at step
+// changes. Steps are scheduled against absolute deadlines (deadline +=
+// duration), lateness of a step does not shift the steps that follow.
+#define SCHED_TICKS_PER_100MS   6250
+#define SCHED_US_PER_TICK       16
+volatile uint16_t schedOverflows = 0;
+uint32_t stepDeadline;
+// step lateness statistics in scheduler ticks, 'd' over Serial prints them
+uint32_t driftSteps;
+uint32_t driftLast;
+uint32_t driftMax;
+uint32_t driftSum;
+
+// Telemetry. Binary frames (see seqformat.h) are queued and handed to the
+// Serial transmit buffer from loop() only when it has room for a whole
+// frame, so sending never blocks the step timing. Frames that do not fit
+// in the queue are dropped and counted. Level 0 sends nothing, 1 only the
+// events (open, rewind, underrun, stop), 2 also every step shown; the level
+// is set by sending '0', '1' or '2' over Serial.
+#define TELEMETRY_QUEUE_SIZE  4     // power of 2
+SeqtFrame telemetryQueue[TELEMETRY_QUEUE_SIZE];
+uint8_t telemetryHead = 0;          // next slot to fill
+uint8_t telemetryTail = 0;          // next frame to send
+uint8_t telemetryLevel = 2;
+uint16_t telemetryDropped = 0;
+// steps shown since the file was opened
+uint16_t stepIndex;
 
 // the interrupt service routine affects this
 volatile bool encoderRotated = false;
@@ -115,12 +168,151 @@ void senseEncoderRotated1() {
   }
 }
 
+ISR(TIMER1_OVF_vect) {
+  schedOverflows++;
+}
+
+// compare match is set to the step deadline; only wakes up the CPU
+ISR(TIMER1_COMPA_vect) {
+}
+
+void schedInit() {
+  TCCR1A = 0;
+  TCCR1B = _BV(CS12);   // normal mode, clk/256
+  TCNT1 = 0;
+  TIFR1 = _BV(TOV1) | _BV(OCF1A);
+  TIMSK1 = _BV(TOIE1) | _BV(OCIE1A);
+  set_sleep_mode(SLEEP_MODE_IDLE);
+}
+
+// current scheduler time in ticks
+uint32_t schedTime() {
+  uint8_t sreg = SREG;
+  cli();
+  uint16_t low = TCNT1;
+  uint16_t high = schedOverflows;
+  // overflow happened but the interrupt was not handled yet
+  if ((TIFR1 & _BV(TOV1)) && (low < 0x8000)) {
+    high++;
+  }
+  SREG = sreg;
+  return ((uint32_t)high << 16) | low;
+}
+
+// queue a telemetry frame; step may be NULL for the events
+void telemetrySend(uint8_t type, uint16_t index, uint32_t late, const SeqbStep *step) {
+  if ((telemetryLevel == 0) || ((type == SEQT_STEP) && (telemetryLevel < 2))) {
+    return;
+  }
+  if ((uint8_t)(telemetryHead - telemetryTail) >= TELEMETRY_QUEUE_SIZE) {
+    telemetryDropped++;
+    return;
+  }
+  SeqtFrame *frame = &telemetryQueue[telemetryHead & (TELEMETRY_QUEUE_SIZE - 1)];
+  memset(frame, 0, sizeof(SeqtFrame));
+  frame->sync = SEQT_SYNC;
+  frame->type = type;
+  frame->step = index;
+  frame->time = schedTime();
+  frame->late = late;
+  if (step) {
+    memcpy(frame->color1, step->color1, 3);
+    memcpy(frame->color2, step->color2, 3);
+    frame->duration = step->duration;
+  }
+  uint8_t check = 0;
+  uint8_t *p = (uint8_t *)frame;
+  for (uint8_t i = 0; i < sizeof(SeqtFrame) - 1; i++) {
+    check ^= p[i];
+  }
+  frame->check = check;
+  telemetryHead++;
+}
+
+// hand queued frames to the Serial transmit buffer, without waiting
+void telemetryFlush() {
+  while ((telemetryHead != telemetryTail) &&
+         (Serial.availableForWrite() >= (int)sizeof(SeqtFrame))) {
+    Serial.write((const uint8_t *)&telemetryQueue[telemetryTail & (TELEMETRY_QUEUE_SIZE - 1)], sizeof(SeqtFrame));
+    telemetryTail++;
+  }
+}
+
+void driftReset() {
+  driftSteps = 0;
+  driftLast = 0;
+  driftMax = 0;
+  driftSum = 0;
+}
+
+void driftPrint() {
+  Serial.print("drift: steps "); Serial.print(driftSteps);
+  Serial.print(" late last "); Serial.print(driftLast * SCHED_US_PER_TICK);
+  Serial.print(" us max "); Serial.print(driftMax * SCHED_US_PER_TICK);
+  Serial.print(" us avg ");
+  Serial.print(driftSteps ? (driftSum / driftSteps) * SCHED_US_PER_TICK : 0);
+  Serial.print(" us, telemetry dropped "); Serial.println(telemetryDropped);
+}
+
 void oledDrawText(uint16_t x, uint16_t y, const char *text, uint16_t color, uint16_t bgcolor = BLACK) {
   oled.setCursor(x, y);
   oled.setTextColor(color, bgcolor);
   oled.print(text);
 }
 
+// the index file is not a sequence file
+uint8_t isIndexFile(const char *name) {
+  return strcasecmp(name, SEQX_FILE) == 0;
+}
+
+// Open the SD card index and take the number of files from it. Returns 0
+// if there is no (valid) index, the directory is walked then.
+uint8_t openIndex() {
+  SeqxHeader header;
+  indexFile = SD.open(SEQX_FILE);
+  if (! indexFile) {
+    return 0;
+  }
+  if ((indexFile.read((uint8_t *)&header, sizeof(header)) != sizeof(header)) ||
+      (header.magic[0] != SEQX_MAGIC0) || (header.magic[1] != SEQX_MAGIC1) ||
+      (header.magic[2] != SEQX_MAGIC2) || (header.magic[3] != SEQX_MAGIC3) ||
+      (header.version != SEQX_VERSION) ||
+      (header.recordSize != sizeof(SeqxRecord))) {
+    Serial.println("invalid index file");
+    indexFile.close();
+    return 0;
+  }
+  indexHeaderSize = header.headerSize;
+  nrFiles = header.numRecords;
+  return 1;
+}
+
+// Fill the filenames window around the selected file from the index. Each
+// record is a seek and a read, the cost does not depend on number of files.
+void getIndexFileNames(int selected) {
+  SeqxRecord record;
+  selectedInfo[0] = 0;
+  for (int i = 0; i < 5; i++) {
+    int item = selected - 2 + i;
+    filenames[i][0] = 0;
+    if ((item < 0) || (item >= nrFiles)) {
+      continue;
+    }
+    indexFile.seek(indexHeaderSize + (uint32_t)item * sizeof(SeqxRecord));
+    if (indexFile.read((uint8_t *)&record, sizeof(record)) != sizeof(record)) {
+      continue;
+    }
+    strncpy(filenames[i], record.fileName, 12);
+    filenames[i][12] = 0;
+    if (i == 2) {
+      // m:ss name, fits the 21 characters of a display line
+      uint32_t secs = record.duration / 10;
+      record.name[SEQX_NAME_LEN - 1] = 0;
+      snprintf(selectedInfo, sizeof(selectedInfo), "%2u:%02u %s", (unsigned)(secs / 60), (unsigned)(secs % 60), record.name);
+    }
+  }
+}
+
 void printDirectory(File dir) {
   while (true) {
     File entry =  dir.openNextFile();
@@ -131,7 +323,7 @@ void printDirectory(File dir) {
       break;
     }
 //    Serial.print(entry.name());
-    if (entry.isDirectory()) {
+    if (entry.isDirectory() || isIndexFile(entry.name())) {
 //      Serial.println("Skipping directory..");/
     } else {
       // files have sizes, directories do not
@@ -144,75 +336,63 @@ void printDirectory(File dir) {
   }
 }
 
-// Read the root folder for files and copy count names to the filenames
-// buffers. As long as start is small (< 10) the response is fine. With
-// start at 30 it takes longer to traverse the folder and UI is jerky..
-// XXX: Consider using a single file with known name listing all the
-//      other filenames.
-void getFileNames(File dir, uint16_t start, uint16_t count) {
-  uint16_t index = 0;
-  uint16_t pos = 0;
-
-  if (start == 0) {
-    pos++;
-    pos++;
-  }
-  if (start == 1) {
-    pos++;
-    start--;
+// Read directory entry item (counting files only) into name. Entries are
+// read forward from the directory cursor, so walking the list one file at a
+// time costs one openNextFile() per step; only an item behind the cursor
+// needs the directory to be rewound and walked from the start.
+uint8_t readDirEntry(File dir, uint16_t item, char *name) {
+  if (item < dirCursor) {
+    dir.rewindDirectory();
+    dirCursor = 0;
   }
-  if ((start >= 2) && (start <= (nrFiles - 2))) {
-    start--;
-    start--;
-  }
-
-  if (start == (nrFiles - 1)) {
-    start--;
-    start--;
-    count--;
-    count--;
-  }
-
-  if (start == (nrFiles - 2)) {
-    start--;
-    count--;
-  }
-
-  for(uint16_t i = 0; i < 5; i++) {
-    filenames[i][0] = 0;
-  }
-
-//  Serial.print(" >> index "); Serial.print(index); Serial.print(", pos "); Serial.println(pos);
-
   while (true) {
     File entry =  dir.openNextFile();
     if (! entry) {
       // no more files
-      break;
+      dir.rewindDirectory();
+      dirCursor = 0;
+      return 0;
     }
-    if (entry.isDirectory()) {
-//      Serial.println("Skipping directory..");/
-    } else {
-      if ((index >= start) && (index < (start + count))) {
-//        Serial.print(" ++ index "); Serial.print(index); Serial.print(", pos "); Serial.println(pos);
-        strcpy(filenames[pos], entry.name());
-        filenames[pos][12] = 0;
-        pos++;
-      } else {
-//        Serial.print(" -- index "); Serial.print(index); Serial.print(", pos "); Serial.println(pos);
-      }
-      index++;
+    if (entry.isDirectory() || isIndexFile(entry.name())) {
+      entry.close();
+      continue;
     }
-    entry.close();
-    if (pos == count) {
-      break;
+    if (dirCursor++ == item) {
+      strncpy(name, entry.name(), 12);
+      name[12] = 0;
+      entry.close();
+      return 1;
     }
+    entry.close();
   }
+}
 
-//  Serial.print(" << index "); Serial.print(index); Serial.print(", pos "); Serial.println(pos);
+// Update the filenames window to show the files around the selected one.
+// The window slides: when the selection moves by one file, four names are
+// kept and only the one that scrolls in is read from the directory.
+// Only used without an index file, see getIndexFileNames().
+void getFileNames(File dir, int selected) {
+  int shift = selected - windowSelected;
+  int first = 0;
+  int last = 4;
+  if ((windowSelected >= 0) && (shift == 0)) {
+    return;
+  } else if ((windowSelected >= 0) && (shift == 1)) {
+    memmove(filenames[0], filenames[1], 4 * sizeof(filenames[0]));
+    first = 4;
+  } else if ((windowSelected >= 0) && (shift == -1)) {
+    memmove(filenames[1], filenames[0], 4 * sizeof(filenames[0]));
+    last = 0;
+  }
+  windowSelected = selected;
 
-  // return to the first file in the directory
-  dir.rewindDirectory();
+  for (int i = first; i <= last; i++) {
+    int item = selected - 2 + i;
+    filenames[i][0] = 0;
+    if ((item >= 0) && (item < nrFiles)) {
+      readDirEntry(dir, item, filenames[i]);
+    }
+  }
 }
 
 long parseInt(const char *buffer, const size_t length) {
@@ -265,6 +445,118 @@ long parseHex(const char *buffer, const size_t length) {
   return value;
 }
 
+uint8_t stepBufferCount() {
+  return (uint8_t)(stepHead - stepTail);
+}
+
+// Read next fixed size step record of a compiled sequence file. Wraps around
+// to the first step at the end of the file.
+bool readStepRecord(SeqbStep *step) {
+  if (dataFile.read((uint8_t *)step, sizeof(SeqbStep)) == sizeof(SeqbStep)) {
+    return true;
+  }
+  telemetrySend(SEQT_REWIND, stepIndex + stepBufferCount(), 0, NULL);
+  dataFile.seek(seqbHeader.headerSize);
+  return (dataFile.read((uint8_t *)step, sizeof(SeqbStep)) == sizeof(SeqbStep));
+}
+
+// Read next data line of a text sequence file and parse it into a step
+// record. Comment (name, description) and empty lines are skipped. Wraps
+// around to the first line at the end of the file.
+bool readStepLine(SeqbStep *step) {
+  uint8_t rewound = 0;
+  uint32_t color;
+
+  while (true) {
+    if (dataFile.peek() == -1) {
+      if (rewound) {
+        // no data lines in the file
+        return false;
+      }
+      telemetrySend(SEQT_REWIND, stepIndex + stepBufferCount(), 0, NULL);
+      // go to start of the file
+      dataFile.seek(0);
+      rewound = 1;
+    }
+    // get the line of text into the buffer
+    buffLen = dataFile.readBytesUntil('\n', buff, 31);
+    if (buffLen == 0) {
+      continue;
+    }
+    // terminate the string
+    buff[buffLen] = '\0';
+    if (buff[0] == '#') {
+      // name and description lines can be longer than the buffer
+      if (buffLen == 31) {
+        while ((dataFile.available()) && (dataFile.read() != '\n'));
+      }
+      continue;
+    }
+    if (buff[0] == '\r') {
+      continue;
+    }
+    break;
+  }
+
+  // file data line : XX AAAAAA YY BBBBBB CC
+  //  XX       - panel 1 control byte  (00 by default)
+  //  AAAAAA   - panel 1 RGB color
+  //  YY       - panel 2 control byte  (00 by default)
+  //  BBBBBB   - panel 2 RGB color
+  //  CC       - time (in 100 ms)
+  // Example:
+  // # this is a name (max 31 chars)
+  // # this is description (max 255 chars)
+  // # description can span several lines..
+  // # first line without leading # is data line
+  // 00 70E79f 00 E6d3e7 36
+  // 00 000000 00 000000 18
+  // 00 cFdbCe 00 FcC2a5 18
+  // 00 000000 00 000000 13
+  // 00 0245B5 00 BdcB5e 23
+  // Notes:
+  //   - color 000000 means LED off
+  step->mode1 = parseHex(buff, 2);
+  color = parseHex(buff+3, 8);
+  step->color1[0] = color >> 16;
+  step->color1[1] = color >> 8;
+  step->color1[2] = color;
+  step->mode2 = parseHex(buff+10, 2);
+  color = parseHex(buff+13, 8);
+  step->color2[0] = color >> 16;
+  step->color2[1] = color >> 8;
+  step->color2[2] = color;
+  step->duration = parseInt(buff+20, 2);
+  return true;
+}
+
+// Read one more step into the read-ahead buffer, if there is room.
+bool fillStepBuffer() {
+  if (stepBufferCount() == STEP_BUFFER_SIZE) {
+    return true;
+  }
+  SeqbStep *step = &stepBuffer[stepHead & (STEP_BUFFER_SIZE - 1)];
+  bool ok = fileBinary ? readStepRecord(step) : readStepLine(step);
+  if (ok) {
+    stepHead++;
+  }
+  return ok;
+}
+
+// Check if the opened file is a compiled sequence; leaves the file
+// positioned at the first step (binary) or at the start (text).
+bool openedBinaryFile() {
+  if ((dataFile.read((uint8_t *)&seqbHeader, sizeof(seqbHeader)) == sizeof(seqbHeader)) &&
+      (seqbHeader.magic[0] == SEQB_MAGIC0) && (seqbHeader.magic[1] == SEQB_MAGIC1) &&
+      (seqbHeader.magic[2] == SEQB_MAGIC2) && (seqbHeader.magic[3] == SEQB_MAGIC3) &&
+      (seqbHeader.version == SEQB_VERSION) && (seqbHeader.stepSize == sizeof(SeqbStep))) {
+    dataFile.seek(seqbHeader.headerSize);
+    return true;
+  }
+  dataFile.seek(0);
+  return false;
+}
+
 void setColorRGB(uint16_t idx, uint8_t r, uint8_t g, uint8_t b) 
 {
   if(idx < NUM_PANELS) 
@@ -313,6 +605,7 @@ void render(void)
   // For a full description of each assembly instruction consult the AVR
   // manual here: http://www.atmel.com/images/doc0856.pdf
 
+#if defined(__AVR__)
   volatile uint16_t
     i   = NUM_RGB;  // Loop counter
   volatile uint8_t
@@ -497,6 +790,12 @@ void render(void)
     : [ptr]    "e" (ptr),
       [hi]     "r" (hi),
       [lo]     "r" (lo));
+#else
+  // host emulator (see emu/), the mock HAL takes the time the bits take to
+  // send with the interrupts disabled
+  cli();
+  emuRender(rgb_arr, NUM_PANELS, NUM_RGB);
+#endif
 
   sei();                          // Enable interrupts
   t_f = micros();                 // t_f will be used to measure the 300us 
@@ -541,6 +840,7 @@ void setBrightness(uint8_t b) {
 void setup() {
   // init the variables early
   memset(filenames, 0, sizeof(filenames));
+  selectedInfo[0] = 0;
   fsmState = fsmIdle;
   counter = 0;
   subCounter = 1;
@@ -590,11 +890,18 @@ void setup() {
 
   t_f = micros();
 
+  schedInit();
+  driftReset();
+
   // intial LED brightness ~10%
   setBrightness(25);
 
   root = SD.open("/");
-  printDirectory(root);
+  if (openIndex()) {
+    Serial.println("using index " SEQX_FILE);
+  } else {
+    printDirectory(root);
+  }
   Serial.println("setup() done!");
   Serial.print("# files: ");
   Serial.println(nrFiles);
@@ -644,8 +951,6 @@ void loop() {
         fsmState = fsmFileSelect;
       } else if ((fsmState == fsmFileSelect) ||
                   (fsmState == fsmFileOpen) ||
-                  (fsmState == fsmHandleNameLine) ||
-                  (fsmState == fsmHandleDescriptionLine) ||
                   (fsmState == fsmHandleDataLine) ||
                   (fsmState == fsmSequenceRun)) {
         // in the main menu, button pressed to stop current run
@@ -665,42 +970,25 @@ void loop() {
   // Update previousStateSW with the current state
   previousStateSW = buttonState;
 
-  // if dataFile is opened and readNextLine is set
-  // read a line from file into buffer
-  if (dataFile && readNextLine) {
-    if (dataFile.peek() == -1) {
-      Serial.println("EOF.. rewind!");
-      // go to start of the file
-      dataFile.seek(0);
-    }
-    // get the line of text into the buffer
-    buffLen = dataFile.readBytesUntil('\n', buff, 31);
-    if (buffLen > 0) {
-      // terminate the string
-      buff[buffLen] = '\0';
-
-      // check the first character of the buffer
-      if (buff[0] == '#') {
-        // this is a commented line
-        if (fsmState == fsmFileOpen) {
-          // first line of the file; short sequence name
-          fsmState = fsmHandleNameLine;
-        } else {
-          // other lines of the file; sequence description
-          fsmState = fsmHandleDescriptionLine;
-        }
-      } else {
-        // data line (not a comment)
-        fsmState = fsmHandleDataLine;
-      }
-    } else {
-      // errors?
-//      Serial.println("WTF?!!");
-      fsmState = fsmSequenceStop;
+  telemetryFlush();
+
+  // commands over Serial
+  if (Serial.available()) {
+    char c = Serial.read();
+    switch (c) {
+      case '0':
+      case '1':
+      case '2':
+        telemetryLevel = c - '0';
+        break;
+      case 'd':
+        driftPrint();
+        break;
+      case 'r':
+        driftReset();
+        break;
     }
   }
-  // make sure we do not try to read file when not desired!
-  readNextLine = 0;
 
   // handle FSM states
   if (fsmState == fsmIdle) {
@@ -717,7 +1005,13 @@ void loop() {
           sprintf(buff, "Files   %3d / %3d", counter + 1, nrFiles);
           oledDrawText(0, 10, buff, WHITE);
 
-          getFileNames(root, counter, 5);
+          if (indexFile) {
+            getIndexFileNames(counter);
+            oled.fillRect(0, 40, 128, 10, BLACK);
+            oledDrawText(0, 40, selectedInfo, CYAN);
+          } else {
+            getFileNames(root, counter);
+          }
 
           uint16_t fgcolor = GREEN;
           uint16_t bgcolor = BLACK;
@@ -748,82 +1042,79 @@ void loop() {
       oled.fillRect(0, 30, 128, 10, BLACK);
       sprintf(buff, "Active   %s", dataFile.name());
       oledDrawText(0, 30, buff, YELLOW);
+      fileBinary = openedBinaryFile();
+      stepHead = 0;
+      stepTail = 0;
       // move to next state
       fsmState = fsmFileOpen;
-      readNextLine = 1;
     } else {
       // error: move to intial state
       fsmState = fsmIdle;
     }
 
   } else if (fsmState == fsmFileOpen) {
-    // nothing to do here; see buffer handling above
-    readNextLine = 1;
-
-  } else if (fsmState == fsmHandleNameLine) {
-    // buffer holds short sequence name
-    // TODO: show it on display
-    readNextLine = 1;
-
-  } else if (fsmState == fsmHandleDescriptionLine) {
-    // buffer holds (part of) sequence description
-    // TODO: show it on display
-    readNextLine = 1;
-    
+    // fill the read-ahead buffer before the first step is shown
+    while ((stepBufferCount() < STEP_BUFFER_SIZE) && fillStepBuffer());
+    if (stepBufferCount() > 0) {
+      // first step is due now
+      stepDeadline = schedTime();
+      stepIndex = 0;
+      telemetrySend(SEQT_OPEN, 0, 0, NULL);
+      fsmState = fsmHandleDataLine;
+    } else {
+      // no steps in the file
+      fsmState = fsmSequenceStop;
+    }
+
   } else if (fsmState == fsmHandleDataLine) {
     // Serial.print("File: "); Serial.print(dataFile.name()); Serial.print(" size "); Serial.println(dataFile.size());
 
-    // file data line : XX AAAAAA YY BBBBBB CC
-    //  XX       - panel 1 control byte  (00 by default)
-    //  AAAAAA   - panel 1 RGB color
-    //  YY       - panel 2 control byte  (00 by default)
-    //  BBBBBB   - panel 2 RGB color
-    //  CC       - time (in 100 ms)
-    // Example:
-    // # this is a name (max 31 chars)
-    // # this is description (max 255 chars)
-    // # description can span several lines..
-    // # first line without leading # is data line
-    // 00 70E79f 00 E6d3e7 36
-    // 00 000000 00 000000 18
-    // 00 cFdbCe 00 FcC2a5 18
-    // 00 000000 00 000000 13
-    // 00 0245B5 00 BdcB5e 23
-    // Notes:
-    //   - color 000000 means LED off
-
-    Serial.print(">line "); Serial.print(buffLen); Serial.print(" : "); Serial.print(buff); Serial.println();
-    // parse both panel colors and time to delay
-    mode1 = parseHex(buff, 2);
-    color1 = parseHex(buff+3, 8);
-    mode2 = parseHex(buff+10, 2);
-    color2 = parseHex(buff+13, 8);
-    timeDelay = parseInt(buff+20, 2);
-    Serial.print("mode1: "); Serial.print(mode1, HEX);
-    Serial.print(" col1: "); Serial.print(color1, HEX);
-    Serial.print(" mode2: "); Serial.print(mode2, HEX);
-    Serial.print(" col2: "); Serial.print(color2, HEX);
-    Serial.println();
-    // time in ms to wait in next FSM state
-    timeDelay *= 100;
-    Serial.print("delay: "); Serial.print(timeDelay); Serial.println();
+    if (stepBufferCount() == 0) {
+      // SD card did not keep up, read the step now
+      telemetrySend(SEQT_UNDERRUN, stepIndex, schedTime() - stepDeadline, NULL);
+      fillStepBuffer();
+    }
+    if (stepBufferCount() == 0) {
+      fsmState = fsmSequenceStop;
+      return;
+    }
+    SeqbStep *step = &stepBuffer[stepTail & (STEP_BUFFER_SIZE - 1)];
+    stepTail++;
+    mode1 = step->mode1;
+    mode2 = step->mode2;
+
+    // how late this step is compared to its deadline
+    driftLast = schedTime() - stepDeadline;
+    if (driftLast > driftMax) driftMax = driftLast;
+    driftSum += driftLast;
+    driftSteps++;
+    telemetrySend(SEQT_STEP, stepIndex, driftLast, step);
+    stepIndex++;
 
     // set lights on both panels
-    setColorRGB(0, (uint8_t)(color1 >> 16), (uint8_t)(color1 >> 8), (uint8_t)(color1));
-    setColorRGB(1, (uint8_t)(color2 >> 16), (uint8_t)(color2 >> 8), (uint8_t)(color2));
+    setColorRGB(0, step->color1[0], step->color1[1], step->color1[2]);
+    setColorRGB(1, step->color2[0], step->color2[1], step->color2[2]);
     render();
     
-    // record current time in ms, used in next state
-    timeMillis = millis();
+    // deadline of the next step, relative to the deadline of this one and
+    // not to the time the step was actually shown
+    stepDeadline += (uint32_t)step->duration * SCHED_TICKS_PER_100MS;
+    OCR1A = (uint16_t)stepDeadline;
 
     // move to next state
     fsmState = fsmSequenceRun;
 
   } else if (fsmState == fsmSequenceRun) {
-    // wait until delay elapsed
-    if ((millis() - timeMillis) < timeDelay) {
-      // wait a little bit..
-      delay(10);
+    // wait until the deadline
+    if ((int32_t)(schedTime() - stepDeadline) < 0) {
+      if (stepBufferCount() < STEP_BUFFER_SIZE) {
+        // use the wait to read the next step from the SD card
+        fillStepBuffer();
+      } else {
+        // sleep until the next interrupt: the deadline compare match,
+        // timer 0 tick, encoder or Serial
+        sleep_mode();
+      }
 
       // if encoder value changed adjust brightness accordingly
       if (encoderRotated) {
@@ -837,12 +1128,11 @@ void loop() {
       }
       encoderRotated = false;
 
-      // remain is this state, do not read next line!
+      // remain is this state, show the next step when the delay elapsed
 
     } else {
-      // go to previous state, read next line from file!
+      // go to previous state, show next step from the buffer
       fsmState = fsmHandleDataLine;
-      readNextLine = 1;
     }
     
   } else if (fsmState == fsmSequenceStop) {
@@ -850,7 +1140,9 @@ void loop() {
     if (dataFile) {
       // close the file
       Serial.print("closing file "); Serial.println(dataFile.name());
+      telemetrySend(SEQT_STOP, stepIndex, 0, NULL);
       dataFile.close();
+      fileBinary = 0;
       oled.fillRect(0, 30, 128, 10, BLACK);
       sprintf(buff, "Active   %s", "");
       oledDrawText(0, 30, buff, YELLOW);
@@ -0,0 +1,126 @@
+// Compiled (binary) sequence file format, SD card index and telemetry frames,
+// shared by the sketch and seqtool.
+//
+// A compiled sequence is a fixed size header followed by numSteps fixed size
+// step records. All multi-byte values are little endian (native on both AVR
+// and x86). The file extension is .SQB to stay within 8.3 file names.
+//
+// Compared to the text format there is nothing to parse: each step is
+// fetched with a single read() of sizeof(SeqbStep) bytes.
+
+#ifndef SEQFORMAT_H
+#define SEQFORMAT_H
+
+#include <stdint.h>
+
+#define SEQB_MAGIC0       'S'
+#define SEQB_MAGIC1       'Q'
+#define SEQB_MAGIC2       'B'
+#define SEQB_MAGIC3       '1'
+#define SEQB_VERSION      1
+#define SEQB_EXT          ".sqb"
+
+#define SEQB_NAME_LEN     32
+#define SEQB_DESC_LEN     256
+
+// 304 bytes
+struct SeqbHeader {
+  char magic[4];                    // 'S' 'Q' 'B' '1'
+  uint8_t version;                  // SEQB_VERSION
+  uint8_t stepSize;                 // sizeof(SeqbStep)
+  uint16_t headerSize;              // sizeof(SeqbHeader), steps start here
+  uint32_t numSteps;
+  uint32_t duration;                // total duration in 100 ms ticks
+  char name[SEQB_NAME_LEN];         // '\0' terminated
+  char description[SEQB_DESC_LEN];  // '\0' terminated
+};
+
+// 9 bytes, same information as a text data line XX AAAAAA YY BBBBBB CC
+struct SeqbStep {
+  uint8_t mode1;
+  uint8_t color1[3];                // R, G, B
+  uint8_t mode2;
+  uint8_t color2[3];                // R, G, B
+  uint8_t duration;                 // 100 ms ticks
+};
+
+// leading part of the header the sketch needs; the name and description
+// are skipped by seeking to headerSize
+struct SeqbHeaderStart {
+  char magic[4];
+  uint8_t version;
+  uint8_t stepSize;
+  uint16_t headerSize;
+  uint32_t numSteps;
+  uint32_t duration;
+};
+
+// SD card index, written by seqtool next to the sequence files. Lists the
+// sequence files in browsing order as fixed size records, so that the
+// sketch can seek straight to record N instead of walking the directory.
+// The index file itself is not a sequence and is skipped by both.
+#define SEQX_FILE         "SEQINDEX.DAT"
+#define SEQX_MAGIC0       'S'
+#define SEQX_MAGIC1       'Q'
+#define SEQX_MAGIC2       'X'
+#define SEQX_MAGIC3       '1'
+#define SEQX_VERSION      1
+
+#define SEQX_FILE_LEN     13
+#define SEQX_NAME_LEN     15
+
+// 12 bytes
+struct SeqxHeader {
+  char magic[4];                    // 'S' 'Q' 'X' '1'
+  uint8_t version;                  // SEQX_VERSION
+  uint8_t recordSize;               // sizeof(SeqxRecord)
+  uint16_t headerSize;              // sizeof(SeqxHeader), records start here
+  uint32_t numRecords;
+};
+
+// 32 bytes
+struct SeqxRecord {
+  char fileName[SEQX_FILE_LEN];     // 8.3 file name, '\0' terminated
+  char name[SEQX_NAME_LEN];         // short name, '\0' terminated, truncated
+  uint32_t duration;                // total duration in 100 ms ticks
+};
+
+// Telemetry frames, sent by the sketch over Serial in between the text
+// messages. A frame starts with the SEQT_SYNC byte, which never appears in
+// the (ASCII) text, and ends with a check byte; a reader scans for the sync
+// byte and drops frames with a bad check byte.
+#define SEQT_SYNC         0xA5
+
+enum {
+  SEQT_STEP = 1,                    // step shown
+  SEQT_OPEN,                        // sequence file opened
+  SEQT_REWIND,                      // end of file, steps wrap to the first
+  SEQT_UNDERRUN,                    // read-ahead buffer was empty at deadline
+  SEQT_STOP,                        // sequence stopped
+};
+
+#define SEQT_TICK_US      16        // time unit of time and late
+
+// 20 bytes
+struct SeqtFrame {
+  uint8_t sync;                     // SEQT_SYNC
+  uint8_t type;                     // SEQT_STEP ..
+  uint16_t step;                    // steps shown since the file was opened
+  uint32_t time;                    // time stamp in SEQT_TICK_US ticks
+  uint32_t late;                    // time past the step deadline, in ticks
+  uint8_t color1[3];                // R, G, B
+  uint8_t color2[3];                // R, G, B
+  uint8_t duration;                 // 100 ms ticks
+  uint8_t check;                    // XOR of all the preceding bytes
+};
+
+#if defined(__cplusplus) && (__cplusplus >= 201103L)
+static_assert(sizeof(SeqbHeader) == 304, "SeqbHeader must be packed");
+static_assert(sizeof(SeqbStep) == 9, "SeqbStep must be packed");
+static_assert(sizeof(SeqbHeaderStart) == 16, "SeqbHeaderStart must be packed");
+static_assert(sizeof(SeqxHeader) == 12, "SeqxHeader must be packed");
+static_assert(sizeof(SeqxRecord) == 32, "SeqxRecord must be packed");
+static_assert(sizeof(SeqtFrame) == 20, "SeqtFrame must be packed");
+#endif
+
+#endif // SEQFORMAT_H
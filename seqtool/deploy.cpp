@@ -0,0 +1,340 @@
+#include <stdio.h>
+#include <errno.h>
+#include <ctype.h>
+#include <strings.h>
+#include <math.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#if defined(__linux__)
+#include <sys/vfs.h>
+#elif defined(__APPLE__)
+#include <sys/param.h>
+#include <sys/mount.h>
+#endif
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "deploy.h"
+#include "library.h"
+#include "optimize.h"
+#include "seqformat.h"
+
+// statfs() f_type of FAT and exFAT on Linux
+#define MSDOS_FS_MAGIC  0x4d44
+#define EXFAT_FS_MAGIC  0x2011BAB0
+
+static bool isSequenceFile(const char *name)
+{
+    const char *dot = strrchr(name, '.');
+    return dot && (strcasecmp(dot, ".txt") == 0 || strcasecmp(dot, SEQB_EXT) == 0);
+}
+
+// up to 8 characters of name that are valid in an 8.3 name, upper case
+static std::string baseName(const char *name)
+{
+    std::string base;
+    for (const char *s = name; *s && base.size() < 8; s++) {
+        if (isalnum((unsigned char)*s) || *s == '_' || *s == '-')
+            base += toupper((unsigned char)*s);
+    }
+    if (base.empty())
+        base = "SEQ";
+    return base;
+}
+
+std::vector<CardFile> assignCardNames(SequenceList *sequences, bool compiled)
+{
+    struct Candidate {
+        int index;
+        std::string base;
+        bool fixed;         // loaded from an 8.3 file
+    };
+    std::vector<Candidate> candidates;
+    for (int n = 0; n < sequences->count(); n++) {
+        Sequence *seq = sequences->sequence(n);
+        if (! seq->valid)
+            continue;
+        char name[13];
+        if (seq->getFileName()[0] != '\0' && shortFileName(seq->getFileName(), name)) {
+            char *dot = strrchr(name, '.');
+            if (dot)
+                *dot = '\0';
+            candidates.push_back({ n, name, true });
+        } else {
+            candidates.push_back({ n, baseName(seq->getShortName()), false });
+        }
+    }
+    // names do not depend on the order of the list
+    std::sort(candidates.begin(), candidates.end(), [sequences](const Candidate &a, const Candidate &b) {
+        if (a.fixed != b.fixed)
+            return a.fixed;
+        if (a.base != b.base)
+            return a.base < b.base;
+        int cmp = strcmp(sequences->sequence(a.index)->getShortName(), sequences->sequence(b.index)->getShortName());
+        return (cmp != 0) ? (cmp < 0) : (a.index < b.index);
+    });
+
+    const char *ext = compiled ? ".SQB" : ".TXT";
+    std::unordered_set<std::string> used;
+    std::vector<CardFile> files;
+    for (size_t n = 0; n < candidates.size(); n++) {
+        std::string name = candidates[n].base + ext;
+        for (int k = 1; used.count(name); k++) {
+            std::string suffix = "~" + std::to_string(k);
+            name = candidates[n].base.substr(0, 8 - suffix.size()) + suffix + ext;
+        }
+        used.insert(name);
+        CardFile file;
+        file.index = candidates[n].index;
+        strncpy(file.fileName, name.c_str(), sizeof(file.fileName) - 1);
+        file.fileName[sizeof(file.fileName) - 1] = '\0';
+        files.push_back(file);
+    }
+    std::sort(files.begin(), files.end(),
+              [](const CardFile &a, const CardFile &b) { return strcmp(a.fileName, b.fileName) < 0; });
+    return files;
+}
+
+// true if directory entries stay in creation order, as on the card
+static bool keepsCreationOrder(const char *path)
+{
+#if defined(__linux__)
+    struct statfs st;
+    if (statfs(path, &st) == 0)
+        return (st.f_type == MSDOS_FS_MAGIC) || (st.f_type == EXFAT_FS_MAGIC);
+#elif defined(__APPLE__)
+    struct statfs st;
+    if (statfs(path, &st) == 0)
+        return (strcmp(st.f_fstypename, "msdos") == 0) || (strcmp(st.f_fstypename, "exfat") == 0);
+#endif
+    // can not tell, treat it as a card
+    return true;
+}
+
+// sequence files of the directory in directory order
+static bool listSequenceFiles(const char *path, std::vector<std::string> *names)
+{
+    DIR *dirp = opendir(path);
+    if (dirp == NULL) {
+        fprintf(stderr, "opendir() failed: %s: %d - %s\n", path, errno, strerror(errno));
+        return false;
+    }
+    struct dirent *dp;
+    while ((dp = readdir(dirp)) != NULL) {
+        if (dp->d_name[0] != '.' && isSequenceFile(dp->d_name))
+            names->push_back(dp->d_name);
+    }
+    closedir(dirp);
+    return true;
+}
+
+static std::string upperCase(const std::string &s)
+{
+    std::string upper = s;
+    for (size_t n = 0; n < upper.size(); n++)
+        upper[n] = toupper((unsigned char)upper[n]);
+    return upper;
+}
+
+// write data over the file; truncating keeps its directory entry, where a
+// rename would move it
+static bool writeInPlace(const std::string &path, const std::string &data)
+{
+    FILE *fp = fopen(path.c_str(), "wb");
+    if (fp == NULL) {
+        fprintf(stderr, "fopen() failed: %s: %d %s\n", path.c_str(), errno, strerror(errno));
+        return false;
+    }
+    bool ok = (fwrite(data.data(), 1, data.size(), fp) == data.size());
+    ok = (fclose(fp) == 0) && ok;
+    if (! ok)
+        fprintf(stderr, "failed to write %s: %d %s\n", path.c_str(), errno, strerror(errno));
+    return ok;
+}
+
+static unsigned int longestStep(Sequence *sequence)
+{
+    unsigned int ticks = 0;
+    for (int n = 0; n < sequence->numSteps(); n++)
+        ticks = std::max(ticks, (unsigned int)sequence->getStep(n)->ticks);
+    return ticks;
+}
+
+// true if any sequence was loaded from the directory at path
+static bool isSourceDirectory(SequenceList *sequences, const char *path)
+{
+    struct stat card;
+    if (stat(path, &card) != 0)
+        return false;
+    std::unordered_set<std::string> checked;
+    for (int n = 0; n < sequences->count(); n++) {
+        Sequence *seq = sequences->sequence(n);
+        if (seq->getFileName()[0] == '\0' || ! checked.insert(seq->getFilePath()).second)
+            continue;
+        struct stat st;
+        if (stat(seq->getFilePath(), &st) == 0 && st.st_dev == card.st_dev && st.st_ino == card.st_ino)
+            return true;
+    }
+    return false;
+}
+
+bool deployCard(SequenceList *sequences, const char *cardPath, const DeployOptions &options, DeployResult *result)
+{
+    *result = DeployResult();
+    // the card is cleaned up before it is written, the sequence files would
+    // be gone while their steps may still be needed
+    if (isSourceDirectory(sequences, cardPath)) {
+        fprintf(stderr, "not deploying to %s, sequences were loaded from it\n", cardPath);
+        return false;
+    }
+    std::vector<CardFile> assigned = assignCardNames(sequences, options.compiled);
+    result->numFiles = assigned.size();
+
+    // everything that goes to the card is formatted before the card is
+    // touched; sequences that fail are left out
+    std::vector<std::string> contents(assigned.size());
+    std::vector<char> formatted(assigned.size(), 0);
+    std::atomic<long long> stepsBefore(0);
+    std::atomic<long long> stepsAfter(0);
+    parallelFor(assigned.size(), options.numThreads, [&](int n) {
+        Sequence *seq = sequences->sequence(assigned[n].index);
+        if (! loadSequenceSteps(seq)) {
+            fprintf(stderr, "failed to load %s for %s\n", seq->getShortName(), assigned[n].fileName);
+            return;
+        }
+        stepsBefore += seq->numSteps();
+        // the optimized steps go to the card only; text files always get
+        // their long steps split, the sketch reads 2 digits of duration
+        Sequence optimized;
+        if (options.optimize) {
+            optimized = *seq;
+            optimizeSequence(&optimized, options.compiled ? BINARY_MAX_TICKS : TEXT_MAX_TICKS);
+            seq = &optimized;
+        } else if (! options.compiled) {
+            optimized = *seq;
+            splitLongSteps(&optimized, TEXT_MAX_TICKS);
+            seq = &optimized;
+        }
+        stepsAfter += seq->numSteps();
+        if (! options.compiled && longestStep(seq) > TEXT_MAX_TICKS) {
+            fprintf(stderr, "not deploying %s as %s, random steps longer than 9.9 s\n",
+                    seq->getShortName(), assigned[n].fileName);
+            return;
+        }
+        if (! formatSequence(seq, options.compiled, &contents[n])) {
+            fprintf(stderr, "failed to format %s for %s\n", seq->getShortName(), assigned[n].fileName);
+            return;
+        }
+        formatted[n] = 1;
+    });
+    result->stepsBefore = stepsBefore;
+    result->stepsAfter = stepsAfter;
+    std::vector<CardFile> files;
+    std::vector<std::string> data;
+    for (size_t n = 0; n < assigned.size(); n++) {
+        if (! formatted[n]) {
+            result->failed++;
+            continue;
+        }
+        files.push_back(assigned[n]);
+        data.push_back(std::move(contents[n]));
+    }
+    contents.clear();
+
+    std::vector<std::string> existing;
+    if (! listSequenceFiles(cardPath, &existing))
+        return false;
+    std::unordered_map<std::string, int> position;
+    for (size_t n = 0; n < files.size(); n++)
+        position.emplace(files[n].fileName, n);
+
+    // name on the card of the files that are kept, empty for new files; on
+    // FAT only the files up to the first one out of order are kept, files
+    // created later must not land in a freed entry in front of them
+    bool ordered = keepsCreationOrder(cardPath);
+    std::vector<std::string> kept(files.size());
+    int numKept = 0;
+    bool inOrder = true;
+    for (size_t n = 0; n < existing.size(); n++) {
+        std::unordered_map<std::string, int>::iterator it = position.find(upperCase(existing[n]));
+        bool wanted = (it != position.end());
+        if (ordered) {
+            inOrder = inOrder && wanted && (it->second == numKept);
+            wanted = inOrder;
+        }
+        if (wanted) {
+            kept[it->second] = existing[n];
+            numKept++;
+            continue;
+        }
+        std::string path = std::string(cardPath) + "/" + existing[n];
+        if (remove(path.c_str()) != 0) {
+            fprintf(stderr, "remove() failed: %s: %d %s\n", path.c_str(), errno, strerror(errno));
+            result->failed++;
+        } else if (it == position.end()) {
+            result->removed++;
+        }
+    }
+
+    // new files are created one by one in name order, then filled in parallel
+    std::vector<char> done(files.size(), 0);
+    for (size_t n = 0; n < files.size(); n++) {
+        if (! kept[n].empty())
+            continue;
+        std::string path = std::string(cardPath) + "/" + files[n].fileName;
+        FILE *fp = fopen(path.c_str(), "wb");
+        if (fp == NULL || fclose(fp) != 0) {
+            fprintf(stderr, "failed to create %s: %d %s\n", path.c_str(), errno, strerror(errno));
+            remove(path.c_str());
+            done[n] = -1;
+        }
+    }
+
+    std::atomic<int> written(0);
+    std::atomic<int> skipped(0);
+    std::atomic<int> numFailed(result->failed);
+    parallelFor(files.size(), options.numThreads, [&](int n) {
+        if (done[n] < 0) {
+            numFailed++;
+            return;
+        }
+        std::string path = std::string(cardPath) + "/" + (kept[n].empty() ? files[n].fileName : kept[n]);
+        uint64_t hash;
+        if (! kept[n].empty() && hashFile(path.c_str(), &hash) && hash == hashData(data[n].data(), data[n].size())) {
+            skipped++;
+            done[n] = 1;
+            return;
+        }
+        if (writeInPlace(path, data[n])) {
+            written++;
+            done[n] = 1;
+        } else {
+            // no empty or partly written files on the card
+            remove(path.c_str());
+            numFailed++;
+        }
+    });
+    result->written = written;
+    result->skipped = skipped;
+    result->failed = numFailed;
+
+    // only the files that made it to the card are indexed
+    std::vector<SeqxRecord> records;
+    for (size_t n = 0; n < files.size(); n++) {
+        if (done[n] <= 0)
+            continue;
+        Sequence *seq = sequences->sequence(files[n].index);
+        SeqxRecord record;
+        memset(&record, 0, sizeof(record));
+        strncpy(record.fileName, files[n].fileName, SEQX_FILE_LEN - 1);
+        strncpy(record.name, seq->getShortName(), SEQX_NAME_LEN - 1);
+        record.duration = lroundf(seq->getDuration() * 10);
+        records.push_back(record);
+    }
+    bool ok = (writeIndexRecords(cardPath, &records) >= 0);
+    fprintf(stderr, "deployed %d sequences to %s: %d written, %d unchanged, %d removed, %d failed; %lld of %lld steps\n",
+            result->numFiles, cardPath, result->written, result->skipped, result->removed, result->failed,
+            result->stepsAfter, result->stepsBefore);
+    return ok && (result->failed == 0);
+}
@@ -0,0 +1,61 @@
+#ifndef DEPLOY_H
+#define DEPLOY_H
+
+#include <vector>
+
+#include "sequence.h"
+
+// Export of a whole sequence list onto an SD card directory for the sketch.
+// Every sequence gets a unique 8.3 file name, the files are created in name
+// order and the card index (SEQX_FILE) is written next to them. Files are
+// formatted and written in parallel; files already on the card with the same
+// contents are left alone. Sequence files (.txt and .sqb) on the card that
+// are not part of the list are removed. No GUI dependencies.
+//
+// The sketch lists files in directory order when there is no index. On FAT
+// that is the order the files were created in, so when the card holds files
+// out of order, the ones from the first out of order file on are written
+// again. Other file systems have no such order; a card filled by copying a
+// deployed directory gets the order of the copy tool.
+//
+// With optimize set, the files get coalesced steps (see optimize.h); the
+// sequences in the list are not changed. Text files always get steps over
+// TEXT_MAX_TICKS split; a sequence with a longer random step is not deployed
+// as text.
+
+struct DeployOptions {
+    bool compiled = true;       // .sqb, text files otherwise
+    int numThreads = 0;         // 0 is one per core
+    bool optimize = true;
+};
+
+// one file of the card
+struct CardFile {
+    int index;                  // sequence in the list
+    char fileName[13];          // 8.3, upper case
+};
+
+struct DeployResult {
+    int numFiles = 0;
+    int written = 0;
+    int skipped = 0;            // same contents already on the card
+    int removed = 0;
+    int failed = 0;
+    // steps of the deployed sequences before and after optimizing
+    long long stepsBefore = 0;
+    long long stepsAfter = 0;
+};
+
+// Unique 8.3 names for all valid sequences, in file name order. A sequence
+// loaded from an 8.3 file keeps its name; others are named after their short
+// name, cut to 8 characters, with ~1, ~2, .. on collisions.
+std::vector<CardFile> assignCardNames(SequenceList *sequences, bool compiled);
+
+// Deploy the list to the card directory at cardPath. All files are formatted
+// in memory before the card is changed; a sequence that fails to load or
+// format, or whose file fails to write, is not on the card and not in the
+// index. Refuses a card directory that sequences were loaded from. Returns
+// false if any file or the index failed.
+bool deployCard(SequenceList *sequences, const char *cardPath, const DeployOptions &options, DeployResult *result);
+
+#endif // DEPLOY_H
@@ -0,0 +1,205 @@
+#include <math.h>
+#include <errno.h>
+#include <algorithm>
+#include <string>
+
+#include "generator.h"
+#include "seqformat.h"
+
+const Generator generators[] = {
+    { "Palette", generatePalette },
+    { "HSV sweep", generateHsvSweep },
+    { "Gradient", generateGradient },
+    { "Random", generateRandom },
+    { "Chase", generateChase },
+    { "Breathing", generateBreathing },
+};
+const int numGenerators = sizeof(generators) / sizeof(generators[0]);
+
+static inline unsigned int packRgb(float r, float g, float b)
+{
+    return (Step::packComponent(r) << 16) | (Step::packComponent(g) << 8) | Step::packComponent(b);
+}
+
+unsigned int hsvToRgb(float h, float s, float v)
+{
+    h = (h - floorf(h)) * 6.0f;
+    int i = (int)h;
+    float f = h - i;
+    float p = v * (1.0f - s);
+    float q = v * (1.0f - s * f);
+    float t = v * (1.0f - s * (1.0f - f));
+    switch (i) {
+    case 0: return packRgb(v, t, p);
+    case 1: return packRgb(q, v, p);
+    case 2: return packRgb(p, v, t);
+    case 3: return packRgb(p, q, v);
+    case 4: return packRgb(t, p, v);
+    default: return packRgb(v, p, q);
+    }
+}
+
+// component wise a + (b - a) * t, t in [0, 256]
+static inline unsigned int blend(unsigned int a, unsigned int b, unsigned int t)
+{
+    unsigned int rgb = 0;
+    for (int shift = 0; shift < 24; shift += 8) {
+        int ca = (a >> shift) & 0xFF;
+        int cb = (b >> shift) & 0xFF;
+        rgb |= (unsigned int)(ca + (((cb - ca) * (int)t) >> 8)) << shift;
+    }
+    return rgb;
+}
+
+static inline void setStep(PackedStep *step, unsigned int color1, unsigned int color2, unsigned char ticks)
+{
+    step->mode1 = 0;
+    PackedStep::setColor(step->color1, color1);
+    step->mode2 = 0;
+    PackedStep::setColor(step->color2, color2);
+    step->ticks = ticks;
+}
+
+void generatePalette(const GeneratorParams &params, int first, PackedStep *steps, int count)
+{
+    for (int n = 0; n < count; n++) {
+        unsigned int color = params.palette[(first + n) % GEN_PALETTE_SIZE];
+        setStep(&steps[n], color, color, params.stepTicks);
+    }
+}
+
+void generateHsvSweep(const GeneratorParams &params, int first, PackedStep *steps, int count)
+{
+    double scale = 1.0 / params.numSteps;
+    for (int n = 0; n < count; n++) {
+        float h = (float)((first + n) * scale);
+        setStep(&steps[n], hsvToRgb(h, params.saturation, params.value),
+                hsvToRgb(h + 0.5f, params.saturation, params.value), params.stepTicks);
+    }
+}
+
+void generateGradient(const GeneratorParams &params, int first, PackedStep *steps, int count)
+{
+    // position along the palette in 1/256 of an entry
+    double scale = (params.numSteps > 1) ? 256.0 * (GEN_PALETTE_SIZE - 1) / (params.numSteps - 1) : 0.0;
+    for (int n = 0; n < count; n++) {
+        unsigned int pos = (unsigned int)((first + n) * scale + 0.5);
+        unsigned int k = std::min(pos >> 8, (unsigned int)GEN_PALETTE_SIZE - 2);
+        unsigned int color = blend(params.palette[k], params.palette[k + 1], pos - (k << 8));
+        setStep(&steps[n], color, color, params.stepTicks);
+    }
+}
+
+// splitmix64 finalizer
+static inline uint64_t mix(uint64_t x)
+{
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+void generateRandom(const GeneratorParams &params, int first, PackedStep *steps, int count)
+{
+    uint64_t seed = mix(params.seed);
+    for (int n = 0; n < count; n++) {
+        // one hash gives the hues of both panels
+        uint64_t x = mix(seed + (uint64_t)(first + n) * 0x9e3779b97f4a7c15ULL);
+        float h1 = (uint32_t)(x >> 40) * (1.0f / 16777216.0f);
+        float h2 = (uint32_t)((x >> 8) & 0xFFFFFF) * (1.0f / 16777216.0f);
+        setStep(&steps[n], hsvToRgb(h1, params.saturation, params.value),
+                hsvToRgb(h2, params.saturation, params.value), params.stepTicks);
+    }
+}
+
+void generateChase(const GeneratorParams &params, int first, PackedStep *steps, int count)
+{
+    for (int n = 0; n < count; n++) {
+        int m = first + n;
+        unsigned int color = params.palette[(m / 2) % GEN_PALETTE_SIZE];
+        if (m & 1)
+            setStep(&steps[n], 0, color, params.stepTicks);
+        else
+            setStep(&steps[n], color, 0, params.stepTicks);
+    }
+}
+
+void generateBreathing(const GeneratorParams &params, int first, PackedStep *steps, int count)
+{
+    int period = std::max(2, params.period);
+    // brightness of each step of a breath, dark at the start
+    std::vector<unsigned int> level(period);
+    for (int k = 0; k < period; k++)
+        level[k] = (unsigned int)(256.0 * (0.5 - 0.5 * cos(2.0 * M_PI * k / period)) + 0.5);
+    int k = first % period;
+    int entry = (first / period) % GEN_PALETTE_SIZE;
+    for (int n = 0; n < count; n++) {
+        unsigned int color = blend(0, params.palette[entry], level[k]);
+        setStep(&steps[n], color, color, params.stepTicks);
+        if (++k == period) {
+            k = 0;
+            entry = (entry + 1) % GEN_PALETTE_SIZE;
+        }
+    }
+}
+
+// spread count pattern steps out from the back, step n goes to 2n, with a
+// wait step after each
+static void addWaitSteps(const GeneratorParams &params, PackedStep *steps, int count)
+{
+    for (int n = count - 1; n >= 0; n--) {
+        steps[2 * n] = steps[n];
+        setStep(&steps[2 * n + 1], 0, 0, params.waitTicks);
+    }
+}
+
+bool generateSteps(const GeneratorParams &params, Sequence *sequence)
+{
+    if (params.kind < 0 || params.kind >= numGenerators || params.numSteps < 1)
+        return false;
+    int count = params.numSteps;
+    size_t total = (size_t)count * (params.waitSteps ? 2 : 1);
+    sequence->data.clear();
+    sequence->data.resize(total);
+    PackedStep *steps = sequence->data.data();
+    generators[params.kind].fn(params, 0, steps, count);
+    if (params.waitSteps)
+        addWaitSteps(params, steps, count);
+    sequence->calcDuration();
+    sequence->valid = true;
+    // not saved anywhere yet
+    sequence->dirty = true;
+    return true;
+}
+
+bool generateFile(const GeneratorParams &params, const char *name, const char *description, const char *path)
+{
+    if (params.kind < 0 || params.kind >= numGenerators || params.numSteps < 1)
+        return false;
+    int stride = params.waitSteps ? 2 : 1;
+    uint64_t numSteps = (uint64_t)params.numSteps * stride;
+    uint64_t duration = (uint64_t)params.numSteps * (params.stepTicks + (params.waitSteps ? params.waitTicks : 0));
+    if (numSteps > UINT32_MAX || duration > UINT32_MAX) {
+        fprintf(stderr, "%s: %llu steps do not fit a compiled sequence\n", path, (unsigned long long)numSteps);
+        return false;
+    }
+    // the totals are known up front, the header is written first
+    SeqbHeader header;
+    initBinaryHeader(&header, name, description, numSteps, duration);
+
+    std::string tmpPath;
+    FILE *fp = openTempFile(path, &tmpPath);
+    if (fp == NULL)
+        return false;
+    std::vector<PackedStep> chunk((size_t)GEN_CHUNK_STEPS * stride);
+    bool ok = (fwrite(&header, sizeof(header), 1, fp) == 1);
+    for (int first = 0; ok && first < params.numSteps; first += GEN_CHUNK_STEPS) {
+        int count = std::min(GEN_CHUNK_STEPS, params.numSteps - first);
+        generators[params.kind].fn(params, first, chunk.data(), count);
+        if (params.waitSteps)
+            addWaitSteps(params, chunk.data(), count);
+        // packed steps are written as they are
+        size_t n = (size_t)count * stride;
+        ok = (fwrite(chunk.data(), sizeof(PackedStep), n, fp) == n);
+    }
+    return commitTempFile(fp, ok, tmpPath, path);
+}
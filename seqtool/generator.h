@@ -0,0 +1,65 @@
+#ifndef GENERATOR_H
+#define GENERATOR_H
+
+#include "sequence.h"
+
+// Procedural pattern generators. Each one fills a preallocated step buffer
+// in one go; generateSteps() sizes the sequence steps once, runs the
+// generator on them and spreads in the wait steps. A generator can start at
+// any step of the pattern, so generateFile() streams long patterns to disk
+// in chunks. No GUI dependencies.
+
+#define GEN_PALETTE_SIZE    8
+
+struct GeneratorParams {
+    int kind = 0;                   // index into generators[]
+    int numSteps = 1;               // pattern steps, wait steps not counted
+    unsigned char stepTicks = 10;   // 100 ms ticks
+    bool waitSteps = false;         // black step after each pattern step
+    unsigned char waitTicks = 10;
+    unsigned int palette[GEN_PALETTE_SIZE] = {};   // 0xRRGGBB
+    unsigned int seed = 1;          // random
+    float saturation = 1.0f;        // HSV sweep and random
+    float value = 1.0f;
+    int period = 20;                // steps of one breath
+};
+
+// Write pattern steps first .. first + count - 1 of params.numSteps to steps.
+typedef void (*GeneratorFn)(const GeneratorParams &params, int first, PackedStep *steps, int count);
+
+struct Generator {
+    const char *name;
+    GeneratorFn fn;
+};
+
+// cycle through the palette
+void generatePalette(const GeneratorParams &params, int first, PackedStep *steps, int count);
+// one turn of the hue circle over the sequence, panel 2 half a turn ahead
+void generateHsvSweep(const GeneratorParams &params, int first, PackedStep *steps, int count);
+// linear blend from one palette entry to the next, over the sequence
+void generateGradient(const GeneratorParams &params, int first, PackedStep *steps, int count);
+// random hue on each panel, same seed gives the same sequence; each step is
+// a hash of the seed and its index, so chunks do not depend on each other
+void generateRandom(const GeneratorParams &params, int first, PackedStep *steps, int count);
+// palette colors alternating between the panels, the other one dark
+void generateChase(const GeneratorParams &params, int first, PackedStep *steps, int count);
+// palette colors fading in and out over period steps
+void generateBreathing(const GeneratorParams &params, int first, PackedStep *steps, int count);
+
+extern const Generator generators[];
+extern const int numGenerators;
+
+// Replace the steps of the sequence with the generated pattern.
+bool generateSteps(const GeneratorParams &params, Sequence *sequence);
+
+// pattern steps generated and written at a time by generateFile()
+#define GEN_CHUNK_STEPS     65536
+
+// Write the generated pattern straight to a compiled sequence file, one
+// chunk at a time; memory use does not depend on the number of steps.
+bool generateFile(const GeneratorParams &params, const char *name, const char *description, const char *path);
+
+// 0xRRGGBB from hue, saturation and value in [0, 1]
+unsigned int hsvToRgb(float h, float s, float v);
+
+#endif // GENERATOR_H
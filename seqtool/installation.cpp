@@ -0,0 +1,105 @@
+#include "installation.h"
+
+int Installation::addSequence(Sequence *sequence)
+{
+    uint32_t loop = 0;
+    for (int n = 0; n < sequence->numSteps(); n++)
+        loop += sequence->getStep(n)->ticks;
+    if (loop == 0)
+        return -1;
+    seqFirst.push_back(stepTicks.size());
+    seqSteps.push_back(sequence->numSteps());
+    seqTicks.push_back(loop);
+    for (int n = 0; n < sequence->numSteps(); n++) {
+        PackedStep *step = sequence->getStep(n);
+        stepTicks.push_back(step->ticks);
+        stepColor1.push_back(step->getColor1());
+        stepColor2.push_back(step->getColor2());
+    }
+    return seqFirst.size() - 1;
+}
+
+void Installation::addController(int sequence, uint32_t offset)
+{
+    ctlSequence.push_back(sequence);
+    ctlOffset.push_back(offset % seqTicks[sequence]);
+    ctlStep.push_back(seqFirst[sequence]);
+    ctlNext.push_back(0);
+    panelColor1.push_back(0);
+    panelColor2.push_back(0);
+}
+
+void Installation::clear()
+{
+    stepTicks.clear();
+    stepColor1.clear();
+    stepColor2.clear();
+    seqFirst.clear();
+    seqSteps.clear();
+    seqTicks.clear();
+    ctlSequence.clear();
+    ctlOffset.clear();
+    ctlStep.clear();
+    ctlNext.clear();
+    panelColor1.clear();
+    panelColor2.clear();
+    queue = decltype(queue)();
+    now = 0;
+    changes = 0;
+}
+
+void Installation::reset()
+{
+    std::vector<Event> events;
+    events.reserve(ctlSequence.size());
+    for (size_t c = 0; c < ctlSequence.size(); c++) {
+        // step the offset falls in and the time left of it
+        uint32_t s = seqFirst[ctlSequence[c]];
+        uint32_t end = stepTicks[s];
+        while (end <= ctlOffset[c]) {
+            s++;
+            end += stepTicks[s];
+        }
+        ctlStep[c] = s;
+        ctlNext[c] = end - ctlOffset[c];
+        events.push_back({ ctlNext[c], (uint32_t)c });
+    }
+    // heapify all at once instead of one push per controller
+    queue = decltype(queue)(std::greater<Event>(), std::move(events));
+    now = 0;
+    changes = 0;
+}
+
+void Installation::advanceTo(uint64_t time)
+{
+    while (! queue.empty() && queue.top().time <= time) {
+        Event event = queue.top();
+        queue.pop();
+        uint32_t c = event.controller;
+        uint32_t seq = ctlSequence[c];
+        uint32_t s = ctlStep[c] + 1;
+        if (s == seqFirst[seq] + seqSteps[seq])
+            s = seqFirst[seq];
+        ctlStep[c] = s;
+        // zero duration steps come back right away, the loop has a duration
+        ctlNext[c] = event.time + stepTicks[s];
+        queue.push({ ctlNext[c], c });
+        changes++;
+    }
+    now = time;
+}
+
+void Installation::evaluate()
+{
+    // gather over flat arrays, no branches
+    size_t count = ctlStep.size();
+    const uint32_t *step = ctlStep.data();
+    const uint32_t *color1 = stepColor1.data();
+    const uint32_t *color2 = stepColor2.data();
+    uint32_t *panel1 = panelColor1.data();
+    uint32_t *panel2 = panelColor2.data();
+    for (size_t c = 0; c < count; c++) {
+        panel1[c] = color1[step[c]];
+        panel2[c] = color2[step[c]];
+    }
+}
@@ -0,0 +1,75 @@
+#ifndef INSTALLATION_H
+#define INSTALLATION_H
+
+#include <stdint.h>
+#include <vector>
+#include <queue>
+#include <functional>
+
+#include "sequence.h"
+
+// Simulation of an installation: many controllers, each running its own
+// sequence on two panels, advanced in lock-step on a shared clock. Only the
+// controllers with a step change are touched, taken from a next-event
+// priority queue. Steps and controllers are kept as structures of arrays so
+// that evaluating the colors of all panels is one pass over flat arrays.
+// Times are in 100 ms ticks. No GUI dependencies.
+struct Installation {
+    // steps of all sequences back to back
+    std::vector<uint32_t> stepTicks;
+    std::vector<uint32_t> stepColor1;       // 0xRRGGBB
+    std::vector<uint32_t> stepColor2;
+    // sequences: first step in the step table, number of steps, loop length
+    std::vector<uint32_t> seqFirst;
+    std::vector<uint32_t> seqSteps;
+    std::vector<uint32_t> seqTicks;
+    // controllers: sequence, offset into its loop at time 0, current step
+    // (index into the step table) and time of the next step change
+    std::vector<uint32_t> ctlSequence;
+    std::vector<uint32_t> ctlOffset;
+    std::vector<uint32_t> ctlStep;
+    std::vector<uint64_t> ctlNext;
+    // panel colors, written by evaluate(); two panels per controller
+    std::vector<uint32_t> panelColor1;
+    std::vector<uint32_t> panelColor2;
+
+    struct Event {
+        uint64_t time;
+        uint32_t controller;
+
+        bool operator>(const Event &other) const {
+            return (time > other.time) || ((time == other.time) && (controller > other.controller));
+        }
+    };
+    std::priority_queue<Event, std::vector<Event>, std::greater<Event>> queue;
+
+    uint64_t now = 0;
+    // step changes since reset()
+    uint64_t changes = 0;
+
+    // Add the steps of a sequence, returns its index or -1 if it has no
+    // duration to play.
+    int addSequence(Sequence *sequence);
+    // Add a controller playing the sequence, offset ticks into its loop.
+    void addController(int sequence, uint32_t offset = 0);
+    void clear();
+    // back to time 0, the controllers at their offset
+    void reset();
+    // process all step changes up to and including time
+    void advanceTo(uint64_t time);
+    // time of the next step change
+    uint64_t nextEvent() const {
+        return queue.empty() ? UINT64_MAX : queue.top().time;
+    }
+    // update the panel colors from the current steps
+    void evaluate();
+
+    int numControllers() const {
+        return ctlSequence.size();
+    }
+    int numPanels() const {
+        return 2 * ctlSequence.size();
+    }
+};
+
+#endif // INSTALLATION_H
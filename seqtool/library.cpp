@@ -0,0 +1,377 @@
+#include <stdio.h>
+#include <errno.h>
+#include <ctype.h>
+#include <math.h>
+#include <sys/stat.h>
+#include <string>
+#include <unordered_map>
+
+#include "library.h"
+#include "seqformat.h"
+
+
+std::vector<Sequence> loadSequences(FileList *fileList, int numThreads, std::atomic<int> *numLoaded)
+{
+    std::vector<Sequence> sequences(fileList->count());
+    // every worker stores its result at the file index so the order does not
+    // depend on scheduling
+    parallelFor(fileList->count(), numThreads, [&](int n) {
+        sequences[n] = loadSequence(fileList->getFileName(n));
+        if (numLoaded)
+            (*numLoaded)++;
+    });
+    return sequences;
+}
+
+static std::string manifestPath(const char *filePath)
+{
+    std::string path(filePath);
+    while (path.size() > 1 && path[path.size() - 1] == '/')
+        path.erase(path.size() - 1);
+    return path + ".manifest";
+}
+
+bool readManifest(const char *filePath, std::vector<ManifestRecord> *records)
+{
+    std::string path = manifestPath(filePath);
+    FILE *fp = fopen(path.c_str(), "rb");
+    if (fp == NULL) {
+        // no manifest yet
+        return false;
+    }
+    ManifestHeader header;
+    bool ok = (fread(&header, sizeof(header), 1, fp) == 1) &&
+              (header.magic == MANIFEST_MAGIC) &&
+              (header.version == MANIFEST_VERSION) &&
+              (header.recordSize == sizeof(ManifestRecord));
+    if (ok) {
+        records->resize(header.count);
+        ok = (fread(records->data(), sizeof(ManifestRecord), header.count, fp) == header.count);
+    }
+    fclose(fp);
+    if (! ok) {
+        fprintf(stderr, "ignoring invalid manifest %s\n", path.c_str());
+        records->clear();
+    }
+    return ok;
+}
+
+bool writeManifest(const char *filePath, const std::vector<ManifestRecord> &records)
+{
+    std::string path = manifestPath(filePath);
+    std::string tmpPath;
+    FILE *fp = openTempFile(path.c_str(), &tmpPath);
+    if (fp == NULL)
+        return false;
+    ManifestHeader header;
+    header.magic = MANIFEST_MAGIC;
+    header.version = MANIFEST_VERSION;
+    header.count = records.size();
+    header.recordSize = sizeof(ManifestRecord);
+    bool ok = (fwrite(&header, sizeof(header), 1, fp) == 1) &&
+              (fwrite(records.data(), sizeof(ManifestRecord), records.size(), fp) == records.size());
+    // replace the old manifest in one go so a reader never sees half of it
+    return commitTempFile(fp, ok, tmpPath, path.c_str());
+}
+
+static bool statFile(const char *path, uint64_t *size, int64_t *mtime)
+{
+    struct stat st;
+    if (stat(path, &st) != 0)
+        return false;
+    *size = st.st_size;
+#if defined(__APPLE__)
+    *mtime = (int64_t)st.st_mtimespec.tv_sec * 1000000000 + st.st_mtimespec.tv_nsec;
+#elif defined(_WIN32)
+    *mtime = (int64_t)st.st_mtime * 1000000000;
+#else
+    *mtime = (int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+#endif
+    return true;
+}
+
+static Sequence sequenceFromRecord(const char *filePath, const ManifestRecord &record)
+{
+    Sequence sequence(record.shortName, record.fileName);
+    sequence.setFilePath(filePath);
+    sequence.appendDescription(record.description);
+    sequence.duration = record.duration;
+    sequence.stepCount = record.numSteps;
+    sequence.stepsLoaded = false;
+    sequence.valid = true;
+    return sequence;
+}
+
+static void recordFromSequence(Sequence *sequence, ManifestRecord *record)
+{
+    memcpy(record->shortName, sequence->shortName, 32);
+    memcpy(record->description, sequence->description, 256);
+    record->shortName[31] = '\0';
+    record->description[255] = '\0';
+    record->duration = sequence->getDuration();
+    record->numSteps = sequence->numSteps();
+}
+
+std::vector<Sequence> loadLibrary(const char *filePath, std::atomic<int> *numFiles, std::atomic<int> *numLoaded)
+{
+    FileList fileList = loadFileList(filePath);
+    // readdir() order depends on the file system, sort by name
+    std::sort(fileList.data.begin(), fileList.data.end(),
+              [](const FileName &a, const FileName &b) { return strcmp(a.name, b.name) < 0; });
+    if (numFiles)
+        *numFiles = fileList.count();
+
+    std::vector<ManifestRecord> oldRecords;
+    readManifest(filePath, &oldRecords);
+    std::unordered_map<std::string, size_t> oldIndex;
+    for (size_t n = 0; n < oldRecords.size(); n++) {
+        oldRecords[n].fileName[31] = '\0';
+        oldIndex[oldRecords[n].fileName] = n;
+    }
+
+    std::vector<Sequence> sequences(fileList.count());
+    std::vector<ManifestRecord> records(fileList.count());
+    std::vector<char> haveRecord(fileList.count(), 0);
+    std::atomic<int> numParsed(0);
+    parallelFor(fileList.count(), 0, [&](int n) {
+        FileName *fn = fileList.getFileName(n);
+        char path[256];
+        snprintf(path, sizeof(path), "%s/%s", fn->path, fn->name);
+        ManifestRecord &record = records[n];
+        memset(&record, 0, sizeof(record));
+        strncpy(record.fileName, fn->name, 31);
+        if (statFile(path, &record.size, &record.mtime)) {
+            auto it = oldIndex.find(fn->name);
+            const ManifestRecord *old = (it != oldIndex.end()) ? &oldRecords[it->second] : NULL;
+            // same size and time stamp, or only the time stamp has changed
+            // but not the content: take the header from the manifest
+            bool unchanged = old && (old->size == record.size) && (old->mtime == record.mtime);
+            if (! unchanged && old && (old->size == record.size) &&
+                hashFile(path, &record.hash) && (record.hash == old->hash)) {
+                unchanged = true;
+            }
+            if (unchanged) {
+                int64_t mtime = record.mtime;
+                record = *old;
+                record.mtime = mtime;
+                sequences[n] = sequenceFromRecord(fn->path, record);
+                haveRecord[n] = 1;
+            } else {
+                sequences[n] = loadSequence(fn);
+                numParsed++;
+                if (sequences[n].valid && hashFile(path, &record.hash)) {
+                    recordFromSequence(&sequences[n], &record);
+                    haveRecord[n] = 1;
+                }
+            }
+        }
+        if (numLoaded)
+            (*numLoaded)++;
+    });
+
+    // drop records of files that are gone or failed to load
+    std::vector<ManifestRecord> newRecords;
+    newRecords.reserve(records.size());
+    for (size_t n = 0; n < records.size(); n++) {
+        if (haveRecord[n])
+            newRecords.push_back(records[n]);
+    }
+    writeManifest(filePath, newRecords);
+    fprintf(stderr, "library %s: %d files, %d parsed\n", filePath, fileList.count(), (int)numParsed);
+    return sequences;
+}
+
+bool shortFileName(const char *name, char *out)
+{
+    const char *dot = strrchr(name, '.');
+    size_t baseLen = dot ? (size_t)(dot - name) : strlen(name);
+    size_t extLen = dot ? strlen(dot + 1) : 0;
+    if (baseLen < 1 || baseLen > 8 || extLen > 3)
+        return false;
+    size_t len = strlen(name);
+    for (size_t n = 0; n < len; n++) {
+        if ((name + n != dot) && ! isalnum((unsigned char)name[n]) && ! strchr("_-~!#$%&'(){}^@`", name[n]))
+            return false;
+        out[n] = toupper((unsigned char)name[n]);
+    }
+    out[len] = '\0';
+    return true;
+}
+
+int writeCardIndex(const char *filePath)
+{
+    // index the files on the card, not the sequence list: it may hold
+    // sequences from other directories and leaves out duplicate short names;
+    // no manifest, it would land on the card next to the directory
+    FileList fileList = loadFileList(filePath);
+    std::vector<Sequence> sequences = loadSequences(&fileList);
+    std::vector<SeqxRecord> records;
+    for (size_t n = 0; n < sequences.size(); n++) {
+        Sequence *seq = &sequences[n];
+        if (! seq->valid)
+            continue;
+        SeqxRecord record;
+        memset(&record, 0, sizeof(record));
+        if (! shortFileName(seq->getFileName(), record.fileName)) {
+            fprintf(stderr, "not indexing %s, not an 8.3 file name\n", seq->getFileName());
+            continue;
+        }
+        strncpy(record.name, seq->getShortName(), SEQX_NAME_LEN - 1);
+        record.duration = lroundf(seq->getDuration() * 10);
+        records.push_back(record);
+    }
+    return writeIndexRecords(filePath, &records);
+}
+
+int writeIndexRecords(const char *filePath, std::vector<SeqxRecord> *recordList)
+{
+    std::vector<SeqxRecord> &records = *recordList;
+    // the sketch shows the files in index order
+    std::sort(records.begin(), records.end(),
+              [](const SeqxRecord &a, const SeqxRecord &b) { return strcmp(a.fileName, b.fileName) < 0; });
+
+    SeqxHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic[0] = SEQX_MAGIC0;
+    header.magic[1] = SEQX_MAGIC1;
+    header.magic[2] = SEQX_MAGIC2;
+    header.magic[3] = SEQX_MAGIC3;
+    header.version = SEQX_VERSION;
+    header.recordSize = sizeof(SeqxRecord);
+    header.headerSize = sizeof(SeqxHeader);
+    header.numRecords = records.size();
+
+    std::string path = std::string(filePath) + "/" + SEQX_FILE;
+    std::string tmpPath;
+    FILE *fp = openTempFile(path.c_str(), &tmpPath);
+    if (fp == NULL)
+        return -1;
+    bool ok = (fwrite(&header, sizeof(header), 1, fp) == 1) &&
+              (fwrite(records.data(), sizeof(SeqxRecord), records.size(), fp) == records.size());
+    if (! commitTempFile(fp, ok, tmpPath, path.c_str()))
+        return -1;
+    fprintf(stderr, "wrote index %s: %d files\n", path.c_str(), (int)records.size());
+    return records.size();
+}
+
+bool LibraryLoader::start(const char *filePath_)
+{
+    if (busy)
+        return false;
+    if (thread.joinable())
+        thread.join();
+    strncpy(filePath, filePath_, 255);
+    result.clear();
+    numFiles = 0;
+    numLoaded = 0;
+    busy = true;
+    thread = std::thread([this]() {
+        result = loadLibrary(filePath, &numFiles, &numLoaded);
+        busy = false;
+    });
+    return true;
+}
+
+int LibraryLoader::merge(SequenceList *sequences)
+{
+    if (busy)
+        return 0;
+    if (thread.joinable())
+        thread.join();
+    int added = 0;
+    for (size_t n = 0; n < result.size(); n++) {
+        Sequence &newSequence = result[n];
+        if (! newSequence.valid) {
+            fprintf(stderr, "not adding sequence, failed to load\n");
+        } else if (! sequences->exists(newSequence.getShortName())) {
+            fprintf(stderr, "adding loaded sequence %s..\n", newSequence.getShortName());
+            sequences->addSequence(std::move(newSequence));
+            added++;
+        } else {
+            fprintf(stderr, "not adding sequence, already exists %s..\n", newSequence.getShortName());
+        }
+    }
+    result.clear();
+    return added;
+}
+
+// Give a sequence without a file a file name made of its short name,
+// unique in the list and the directory. False if there is none.
+static bool assignFileName(SequenceList *sequences, int index, const char *filePath)
+{
+    Sequence *seq = sequences->sequence(index);
+    char base[28];
+    size_t n = 0;
+    for (const char *s = seq->getShortName(); *s && n < sizeof(base) - 1; s++)
+        base[n++] = (isalnum((unsigned char)*s) || *s == '-' || *s == '_') ? *s : '_';
+    if (n == 0)
+        base[n++] = '_';
+    base[n] = '\0';
+
+    // base and number are capped so that the name always fits
+    char name[32];
+    bool found = false;
+    for (int k = 1; k <= 9999 && ! found; k++) {
+        if (k == 1)
+            snprintf(name, sizeof(name), "%s.txt", base);
+        else
+            snprintf(name, sizeof(name), "%.20s-%d.txt", base, k);
+        std::string path = std::string(filePath) + "/" + name;
+        struct stat st;
+        found = (sequences->findByFileName(name) < 0 && stat(path.c_str(), &st) != 0);
+    }
+    if (! found) {
+        fprintf(stderr, "no free file name for %s in %s\n", seq->getShortName(), filePath);
+        return false;
+    }
+    seq->setFileName(name);
+    seq->setFilePath(filePath);
+    sequences->fileNameIndex.emplace(name, index);
+    return true;
+}
+
+static bool writeToFile(Sequence *seq)
+{
+    std::string path = std::string(seq->getFilePath()) + "/" + seq->getFileName();
+    if (! writeSequence(seq, path.c_str()))
+        return false;
+    seq->dirty = false;
+    return true;
+}
+
+bool saveSequence(SequenceList *sequences, int index, const char *filePath)
+{
+    Sequence *seq = sequences->sequence(index);
+    if (! seq->stepsLoaded)
+        return true;
+    if (seq->getFileName()[0] == '\0' && ! assignFileName(sequences, index, filePath))
+        return false;
+    bool ok = writeToFile(seq);
+    if (ok)
+        fprintf(stderr, "saved sequence %s to %s/%s\n", seq->getShortName(), seq->getFilePath(), seq->getFileName());
+    return ok;
+}
+
+int saveDirtySequences(SequenceList *sequences, const char *filePath, int numThreads)
+{
+    // file names are handed out up front, the writers share nothing
+    std::vector<int> dirty;
+    int numUnnamed = 0;
+    for (int n = 0; n < sequences->count(); n++) {
+        Sequence *seq = sequences->sequence(n);
+        if (! seq->dirty || ! seq->stepsLoaded)
+            continue;
+        if (seq->getFileName()[0] == '\0' && ! assignFileName(sequences, n, filePath)) {
+            numUnnamed++;
+            continue;
+        }
+        dirty.push_back(n);
+    }
+    std::atomic<int> failed(0);
+    parallelFor(dirty.size(), numThreads, [&](int n) {
+        if (! writeToFile(sequences->sequence(dirty[n])))
+            failed++;
+    });
+    fprintf(stderr, "saved %d sequences, %d failed\n", (int)dirty.size() - failed, (int)failed + numUnnamed);
+    return (failed || numUnnamed) ? -1 : (int)dirty.size();
+}
@@ -0,0 +1,124 @@
+#ifndef LIBRARY_H
+#define LIBRARY_H
+
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+
+#include "sequence.h"
+
+// Run fn(n) for n in [0, count) on a pool of worker threads; numThreads of 0
+// uses one thread per core. The calling thread is one of the workers.
+template <typename F>
+void parallelFor(int count, int numThreads, F fn)
+{
+    if (numThreads <= 0)
+        numThreads = std::max(1u, std::thread::hardware_concurrency());
+    numThreads = std::min(numThreads, count);
+
+    std::atomic<int> next(0);
+    auto worker = [&]() {
+        int n;
+        while ((n = next++) < count) {
+            fn(n);
+        }
+    };
+
+    std::vector<std::thread> pool;
+    for (int n = 1; n < numThreads; n++)
+        pool.push_back(std::thread(worker));
+    worker();
+    for (size_t n = 0; n < pool.size(); n++)
+        pool[n].join();
+}
+
+// Load all sequence files from the list using a pool of worker threads.
+// Results are returned in file list order, numThreads of 0 uses one thread
+// per core. Progress is counted in numLoaded, if given.
+std::vector<Sequence> loadSequences(FileList *fileList, int numThreads = 0, std::atomic<int> *numLoaded = NULL);
+
+// Library manifest, a binary cache file kept next to the library directory
+// (<library path>.manifest). Holds one fixed size record per sequence file
+// so that unchanged files do not need to be parsed again on reload.
+#define MANIFEST_MAGIC      0x464d5153  // "SQMF"
+#define MANIFEST_VERSION    1
+
+struct ManifestHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t count;
+    uint32_t recordSize;
+};
+
+struct ManifestRecord {
+    char fileName[32];
+    uint64_t size;
+    int64_t mtime;          // modification time in ns
+    uint64_t hash;          // see hashFile()
+    char shortName[32];
+    char description[256];
+    float duration;
+    int32_t numSteps;
+};
+
+bool readManifest(const char *filePath, std::vector<ManifestRecord> *records);
+bool writeManifest(const char *filePath, const std::vector<ManifestRecord> &records);
+
+// Load the library directory, parsing only the files that are new or have
+// changed since the manifest was written; others are restored from their
+// manifest record, with steps loaded on first use. Manifest is updated.
+std::vector<Sequence> loadLibrary(const char *filePath, std::atomic<int> *numFiles = NULL, std::atomic<int> *numLoaded = NULL);
+
+// Write the SD card index (SEQX_FILE in seqformat.h) into the directory at
+// filePath, listing the sequence files in it with 8.3 names in file name
+// order. Returns the number of records written or -1 on error.
+int writeCardIndex(const char *filePath);
+// Write the given records as the SD card index, sorted by file name.
+struct SeqxRecord;
+int writeIndexRecords(const char *filePath, std::vector<SeqxRecord> *records);
+// upper case 8.3 name as FAT returns it to the sketch, false if the name
+// does not fit 8.3; out has room for 13 characters
+bool shortFileName(const char *name, char *out);
+
+// Save a sequence: back to the file it was loaded from, in its format, or
+// for new (generated) sequences to a text file in filePath named after the
+// sequence. Clears the dirty flag.
+bool saveSequence(SequenceList *sequences, int index, const char *filePath);
+// Save all dirty sequences, in parallel. Returns the number of sequences
+// saved or -1 if any of them failed.
+int saveDirtySequences(SequenceList *sequences, const char *filePath, int numThreads = 0);
+
+// Loads a whole library directory in the background so that the UI stays
+// responsive. Call merge() once isBusy() returns false.
+struct LibraryLoader {
+    std::thread thread;
+    std::atomic<bool> busy;
+    std::atomic<int> numFiles;
+    std::atomic<int> numLoaded;
+    std::vector<Sequence> result;
+    char filePath[256];
+
+    LibraryLoader() {
+        busy = false;
+        numFiles = 0;
+        numLoaded = 0;
+        memset(filePath, 0, 256);
+    }
+    ~LibraryLoader() {
+        if (thread.joinable())
+            thread.join();
+    }
+    bool start(const char *filePath_);
+    bool isBusy() {
+        return busy;
+    }
+    bool hasResult() {
+        return ! busy && thread.joinable();
+    }
+    // add loaded sequences to the list, in file name order, skipping
+    // invalid and already existing ones; returns number of sequences added
+    int merge(SequenceList *sequences);
+};
+
+#endif // LIBRARY_H
@@ -0,0 +1,86 @@
+#include <algorithm>
+
+#include "optimize.h"
+
+static inline bool sameColors(const PackedStep &a, const PackedStep &b)
+{
+    return (a.mode1 == b.mode1) && (memcmp(a.color1, b.color1, 3) == 0) &&
+           (a.mode2 == b.mode2) && (memcmp(a.color2, b.color2, 3) == 0);
+}
+
+bool optimizeSequence(Sequence *sequence, unsigned int maxTicks, OptimizeStats *stats)
+{
+    const std::vector<PackedStep> &steps = sequence->data;
+    // splitting may give more steps than it takes, write to a new vector
+    std::vector<PackedStep> result;
+    result.reserve(steps.size());
+    int dropped = 0;
+    size_t n = 0;
+    while (n < steps.size()) {
+        PackedStep step = steps[n++];
+        if (step.ticks == 0) {
+            dropped++;
+            continue;
+        }
+        if (step.isRandom1() || step.isRandom2()) {
+            result.push_back(step);
+            continue;
+        }
+        // zero duration steps inside the run do not end it
+        uint64_t ticks = step.ticks;
+        for (; n < steps.size(); n++) {
+            if (steps[n].ticks == 0) {
+                dropped++;
+            } else if (sameColors(step, steps[n])) {
+                ticks += steps[n].ticks;
+            } else {
+                break;
+            }
+        }
+        while (ticks > 0) {
+            step.ticks = std::min(ticks, (uint64_t)maxTicks);
+            result.push_back(step);
+            ticks -= step.ticks;
+        }
+    }
+
+    bool changed = ! result.empty() && ((result.size() != steps.size()) ||
+                   (memcmp(result.data(), steps.data(), result.size() * sizeof(PackedStep)) != 0));
+    if (stats) {
+        stats->stepsBefore = steps.size();
+        stats->stepsAfter = changed ? result.size() : steps.size();
+        stats->dropped = changed ? dropped : 0;
+    }
+    if (! changed)
+        return false;
+    sequence->data.swap(result);
+    sequence->calcDuration();
+    sequence->dirty = true;
+    return true;
+}
+
+bool splitLongSteps(Sequence *sequence, unsigned int maxTicks)
+{
+    const std::vector<PackedStep> &steps = sequence->data;
+    std::vector<PackedStep> result;
+    result.reserve(steps.size());
+    for (size_t n = 0; n < steps.size(); n++) {
+        PackedStep step = steps[n];
+        unsigned int ticks = step.ticks;
+        if (ticks <= maxTicks || step.isRandom1() || step.isRandom2()) {
+            result.push_back(step);
+            continue;
+        }
+        while (ticks > 0) {
+            step.ticks = std::min(ticks, maxTicks);
+            result.push_back(step);
+            ticks -= step.ticks;
+        }
+    }
+    if (result.size() == steps.size())
+        return false;
+    sequence->data.swap(result);
+    sequence->calcDuration();
+    sequence->dirty = true;
+    return true;
+}
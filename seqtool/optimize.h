@@ -0,0 +1,29 @@
+#ifndef OPTIMIZE_H
+#define OPTIMIZE_H
+
+#include "sequence.h"
+
+// Step coalescing: every step costs the sketch a read from the SD card and a
+// render(), whatever its duration. Runs of steps with the same colors are
+// merged into as few steps as the file format can encode (TEXT_MAX_TICKS or
+// BINARY_MAX_TICKS each), and zero duration steps are dropped. Steps with a
+// random color get a new color each time and are left as they are. The loop
+// plays the same as before. No GUI dependencies.
+
+struct OptimizeStats {
+    int stepsBefore = 0;
+    int stepsAfter = 0;
+    int dropped = 0;        // zero duration steps
+};
+
+// Coalesce the steps of the sequence, longest step maxTicks. Steps over
+// maxTicks are split. Returns true if the steps changed; a sequence without
+// any duration is left alone.
+bool optimizeSequence(Sequence *sequence, unsigned int maxTicks, OptimizeStats *stats = NULL);
+
+// Split steps over maxTicks only, nothing is merged or dropped. Steps with a
+// random color are left as they are, a split would change their color
+// halfway. Returns true if the steps changed.
+bool splitLongSteps(Sequence *sequence, unsigned int maxTicks);
+
+#endif // OPTIMIZE_H
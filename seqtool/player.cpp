@@ -0,0 +1,145 @@
+#include <stdio.h>
+
+#include "player.h"
+
+
+bool Player::start(Sequence *sequence_, double position)
+{
+    stop();
+    if (sequence_->numSteps() == 0) {
+        return false;
+    }
+    sequence = std::make_shared<Sequence>(*sequence_);
+    sequence->calcDuration();
+    if (sequence->endTicks() == 0) {
+        // nothing to wait for
+        sequence.reset();
+        return false;
+    }
+    quit = false;
+    seeking = true;
+    seekPosition = position;
+    thread = std::thread(&Player::run, this);
+    return true;
+}
+
+void Player::update(Sequence *sequence_)
+{
+    if (! isPlaying())
+        return;
+    std::shared_ptr<Sequence> copy = std::make_shared<Sequence>(*sequence_);
+    copy->calcDuration();
+    if (copy->endTicks() == 0) {
+        // nothing left to play, same as start() refusing it
+        stop();
+        return;
+    }
+    std::lock_guard<std::mutex> guard(lock);
+    sequence = copy;
+    wake.notify_one();
+}
+
+void Player::seek(double position)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    seeking = true;
+    seekPosition = position;
+    wake.notify_one();
+}
+
+void Player::stop()
+{
+    if (! thread.joinable())
+        return;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        quit = true;
+        wake.notify_one();
+    }
+    thread.join();
+    sequence.reset();
+    PlayerState state;
+    publish(state);
+}
+
+void Player::publish(const PlayerState &state)
+{
+    unsigned int version = snapVersion.load(std::memory_order_relaxed);
+    snapVersion.store(version + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    snapStep.store(state.step, std::memory_order_relaxed);
+    snapColor1.store(state.color1, std::memory_order_relaxed);
+    snapColor2.store(state.color2, std::memory_order_relaxed);
+    snapLoops.store(state.loops, std::memory_order_relaxed);
+    snapOrigin.store(state.origin, std::memory_order_relaxed);
+    snapVersion.store(version + 2, std::memory_order_release);
+}
+
+PlayerState Player::snapshot()
+{
+    PlayerState state;
+    unsigned int v1, v2;
+    do {
+        v1 = snapVersion.load(std::memory_order_acquire);
+        state.step = snapStep.load(std::memory_order_relaxed);
+        state.color1 = snapColor1.load(std::memory_order_relaxed);
+        state.color2 = snapColor2.load(std::memory_order_relaxed);
+        state.loops = snapLoops.load(std::memory_order_relaxed);
+        state.origin = snapOrigin.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        v2 = snapVersion.load(std::memory_order_relaxed);
+    } while ((v1 != v2) || (v1 & 0x01));
+    return state;
+}
+
+double Player::elapsed(const PlayerState &state)
+{
+    if (state.step < 0)
+        return 0;
+    return (now() - state.origin) / 1e9;
+}
+
+void Player::run()
+{
+    PlayerState state;
+    int64_t origin = 0;
+    int cursor = -1;
+    std::unique_lock<std::mutex> guard(lock);
+    while (! quit) {
+        int64_t t = now();
+        if (seeking) {
+            // position the loop start so that t is at seekPosition
+            origin = t - (int64_t)(seekPosition * 1e9);
+            cursor = -1;
+            seeking = false;
+        }
+        // loop length may change when the sequence is edited
+        int64_t loopLength = (int64_t)sequence->endTicks() * 100000000;
+        while (t - origin >= loopLength) {
+            origin += loopLength;
+            state.loops++;
+            cursor = -1;
+        }
+        int step = sequence->findStep((t - origin) / 1e9, cursor);
+        if (step < 0) {
+            // only possible if the clock went backwards
+            step = 0;
+        }
+        if ((step != state.step) || (origin != state.origin)) {
+            PackedStep *s = sequence->getStep(step);
+            state.step = step;
+            state.color1 = s->getColor1();
+            state.color2 = s->getColor2();
+            state.origin = origin;
+            publish(state);
+            if (onStep)
+                onStep(state);
+        }
+        cursor = step;
+        // absolute deadline of the step end, relative to the loop start
+        int64_t deadline = origin + (int64_t)sequence->stepEnd[step] * 100000000;
+        nextTransition = deadline;
+        wake.wait_until(guard, Clock::time_point(std::chrono::duration_cast<Clock::duration>(std::chrono::nanoseconds(deadline))));
+    }
+    nextTransition = 0;
+}
@@ -0,0 +1,88 @@
+#ifndef PLAYER_H
+#define PLAYER_H
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <memory>
+#include <functional>
+#include <chrono>
+
+#include "sequence.h"
+
+// Playback state published by the player thread at each step transition.
+struct PlayerState {
+    // -1 when not playing
+    int step = -1;
+    // 0xRRGGBB
+    unsigned int color1 = 0;
+    unsigned int color2 = 0;
+    // number of times the sequence wrapped around
+    unsigned int loops = 0;
+    // steady clock time (ns) at which the current loop started
+    int64_t origin = 0;
+};
+
+// Real-time playback engine. Runs on its own thread, independent of the UI
+// frame rate, using the monotonic clock and absolute step deadlines so that
+// late wake ups never accumulate into drift. Plays a private copy of the
+// sequence steps; the UI reads the state through a lock-free snapshot.
+struct Player {
+    typedef std::chrono::steady_clock Clock;
+
+    std::thread thread;
+    std::mutex lock;
+    std::condition_variable wake;
+    // guarded by lock
+    bool quit = false;
+    bool seeking = false;
+    double seekPosition = 0;
+    std::shared_ptr<Sequence> sequence;
+    // optional output, called from the player thread at every step change
+    std::function<void(const PlayerState &)> onStep;
+
+    // snapshot, written by the player thread only (seqlock)
+    std::atomic<unsigned int> snapVersion;
+    std::atomic<int> snapStep;
+    std::atomic<unsigned int> snapColor1;
+    std::atomic<unsigned int> snapColor2;
+    std::atomic<unsigned int> snapLoops;
+    std::atomic<int64_t> snapOrigin;
+    // steady clock time (ns) of the next step transition
+    std::atomic<int64_t> nextTransition;
+
+    Player() {
+        snapVersion = 0;
+        snapStep = -1;
+        snapColor1 = 0;
+        snapColor2 = 0;
+        snapLoops = 0;
+        snapOrigin = 0;
+        nextTransition = 0;
+    }
+    ~Player() {
+        stop();
+    }
+    // start playing from position (in seconds)
+    bool start(Sequence *sequence_, double position = 0);
+    // hand over the edited steps of the sequence being played; stops if they
+    // have no duration
+    void update(Sequence *sequence_);
+    void seek(double position);
+    void stop();
+    bool isPlaying() {
+        return thread.joinable();
+    }
+    PlayerState snapshot();
+    // elapsed time in the current loop, in seconds
+    double elapsed(const PlayerState &state);
+    static int64_t now() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now().time_since_epoch()).count();
+    }
+
+    void run();
+    void publish(const PlayerState &state);
+};
+
+#endif // PLAYER_H
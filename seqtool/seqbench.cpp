@@ -0,0 +1,94 @@
+// Sequence loader benchmark
+//
+// Generates a synthetic sequence file and loads it with both the original
+// fgets() / sscanf() loader and the memory mapped loader, reporting the time
+// taken by each and verifying that both produce the same steps.
+//
+// Usage: seqbench [number of steps] [iterations] [directory]
+//
+// The original loader prints every line to stderr; redirect stderr to
+// /dev/null to measure the parsing cost alone.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <chrono>
+
+#include "sequence.h"
+
+static bool writeSequenceFile(const char *path, int numSteps)
+{
+    FILE *fp = fopen(path, "w");
+    if (fp == NULL) {
+        fprintf(stderr, "fopen() failed: %d %s\n", errno, strerror(errno));
+        return false;
+    }
+    fprintf(fp, "# benchmark sequence\n");
+    fprintf(fp, "# generated by seqbench\n");
+    fprintf(fp, "# %d steps\n", numSteps);
+    srand(1);
+    for (int n = 0; n < numSteps; n++) {
+        unsigned int c1 = rand() & 0xFFFFFF;
+        unsigned int c2 = rand() & 0xFFFFFF;
+        fprintf(fp, "%02X %06X %02X %06X %02d\n", n & 0x01, c1, 0, c2, 1 + (rand() % 99));
+    }
+    fclose(fp);
+    return true;
+}
+
+static bool sameSteps(Sequence *a, Sequence *b)
+{
+    if (a->numSteps() != b->numSteps())
+        return false;
+    for (int n = 0; n < a->numSteps(); n++) {
+        if (memcmp(a->getStep(n), b->getStep(n), sizeof(PackedStep)) != 0)
+            return false;
+    }
+    return (strcmp(a->getShortName(), b->getShortName()) == 0) &&
+           (strcmp(a->getDescription(), b->getDescription()) == 0);
+}
+
+template <typename F>
+static double timeLoader(F loader, const FileName *fileName, int iterations, Sequence *result)
+{
+    auto start = std::chrono::steady_clock::now();
+    for (int n = 0; n < iterations; n++) {
+        *result = loader(fileName);
+    }
+    auto stop = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::milli>(stop - start).count() / iterations;
+}
+
+int main(int argc, char **argv)
+{
+    int numSteps = (argc > 1) ? atoi(argv[1]) : 100000;
+    int iterations = (argc > 2) ? atoi(argv[2]) : 5;
+    const char *dir = (argc > 3) ? argv[3] : "/tmp";
+    if (numSteps < 1 || iterations < 1) {
+        fprintf(stderr, "usage: %s [number of steps] [iterations] [directory]\n", argv[0]);
+        return 1;
+    }
+
+    FileName fileName(dir, "seqbench.txt");
+    char path[128];
+    snprintf(path, sizeof(path), "%s/%s", fileName.path, fileName.name);
+    if (! writeSequenceFile(path, numSteps))
+        return 1;
+
+    Sequence seqStdio;
+    Sequence seqMapped;
+    double msStdio = timeLoader(loadSequenceStdio, &fileName, iterations, &seqStdio);
+    double msMapped = timeLoader(loadSequence, &fileName, iterations, &seqMapped);
+    remove(path);
+
+    printf("steps %d, iterations %d\n", numSteps, iterations);
+    printf("  fgets/sscanf : %10.3f ms  %12.0f steps/s\n", msStdio, numSteps / (msStdio / 1000.0));
+    printf("  mmap         : %10.3f ms  %12.0f steps/s\n", msMapped, numSteps / (msMapped / 1000.0));
+    printf("  speedup      : %10.1f x\n", msStdio / msMapped);
+
+    if (! seqMapped.valid || ! sameSteps(&seqStdio, &seqMapped)) {
+        printf("loaders disagree!\n");
+        return 1;
+    }
+    return 0;
+}
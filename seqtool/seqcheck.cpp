@@ -0,0 +1,298 @@
+// Library checks
+//
+// Runs edge cases of the sequence library that are easy to break and hard
+// to see in the GUI. Scratch files go to the directory given with -d
+// (default /tmp). Prints each failed check; exit status is 1 when any
+// failed.
+//
+// Usage: seqcheck [-d dir]
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <string>
+#include <map>
+
+#include "deploy.h"
+#include "library.h"
+#include "optimize.h"
+#include "seqformat.h"
+#include "sequence.h"
+#include "simulation.h"
+
+static int numChecks = 0;
+static int numFailed = 0;
+
+#define CHECK(cond) check((cond), #cond, __FILE__, __LINE__)
+
+static bool check(bool ok, const char *what, const char *file, int line)
+{
+    numChecks++;
+    if (! ok) {
+        printf("%s:%d: check failed: %s\n", file, line, what);
+        numFailed++;
+    }
+    return ok;
+}
+
+// steps of one tick each, so the step index is the time in the loop
+static Sequence makeSequence(const char *name, int numSteps)
+{
+    Sequence sequence(name);
+    sequence.data.resize(numSteps);
+    for (int n = 0; n < numSteps; n++) {
+        PackedStep::setColor(sequence.data[n].color1, n & 0xFFFFFF);
+        PackedStep::setColor(sequence.data[n].color2, ~n & 0xFFFFFF);
+        sequence.data[n].ticks = 1;
+    }
+    sequence.calcDuration();
+    sequence.valid = true;
+    return sequence;
+}
+
+// step indexes over 65535 survive the trace and do not look like a new loop
+static void checkLongTrace(const std::string &dir)
+{
+    const int numSteps = 70000;
+    Sequence sequence = makeSequence("long", numSteps);
+    SimTrace trace;
+    if (! CHECK(simulate(&sequence, 7500, 0, &trace)))
+        return;
+    // 7000 s loop
+    CHECK(trace.events.size() == 75000);
+    CHECK(trace.events.back().loop == 1);
+    CHECK(trace.events[numSteps - 1].step == numSteps - 1);
+
+    std::string path = dir + "/seqcheck.trace";
+    SimTrace readBack;
+    CHECK(writeTrace(path.c_str(), trace));
+    if (CHECK(readTrace(path.c_str(), &readBack)) && CHECK(readBack.events.size() == trace.events.size())) {
+        size_t mismatch = 0;
+        for (size_t n = 0; n < trace.events.size(); n++) {
+            const SimEvent &a = trace.events[n];
+            const SimEvent &b = readBack.events[n];
+            if (a.ticks != b.ticks || a.step != b.step || a.loop != b.loop ||
+                a.color1 != b.color1 || a.color2 != b.color2)
+                mismatch++;
+        }
+        CHECK(mismatch == 0);
+    }
+    remove(path.c_str());
+}
+
+// a multi line description from the editor is written as comment lines
+static void checkDescriptionLines(const std::string &dir)
+{
+    Sequence sequence = makeSequence("lines", 3);
+    sequence.appendDescription("first line\r\nsecond line\n\nthird");
+    std::string path = dir + "/seqcheck.txt";
+    CHECK(writeSequenceText(&sequence, path.c_str()));
+    Sequence loaded = loadSequenceFile(path.c_str());
+    if (CHECK(loaded.valid)) {
+        CHECK(loaded.numSteps() == 3);
+        CHECK(strcmp(loaded.getDescription(), "first line second line third") == 0);
+    }
+    remove(path.c_str());
+}
+
+// formatSequence() gives what the writers put in the file
+static void checkFormatSequence(const std::string &dir)
+{
+    Sequence sequence = makeSequence("format", 5000);
+    sequence.appendDescription("formatted in memory");
+    const char *exts[] = { ".txt", SEQB_EXT };
+    for (int compiled = 0; compiled < 2; compiled++) {
+        std::string path = dir + "/seqcheck" + exts[compiled];
+        std::string data;
+        CHECK(formatSequence(&sequence, compiled, &data));
+        CHECK(writeSequence(&sequence, path.c_str()));
+        uint64_t hash;
+        if (CHECK(hashFile(path.c_str(), &hash)))
+            CHECK(hash == hashData(data.data(), data.size()));
+        remove(path.c_str());
+    }
+}
+
+static void setStep(Sequence *sequence, int n, unsigned int color, unsigned int ticks)
+{
+    PackedStep::setColor(sequence->data[n].color1, color);
+    PackedStep::setColor(sequence->data[n].color2, color);
+    sequence->data[n].ticks = ticks;
+}
+
+// runs are merged and split at maxTicks, zero duration steps dropped and
+// random steps left alone; the loop keeps its duration
+static void checkOptimizer()
+{
+    // one run of 3 x 100 ticks with zero duration steps at both ends and inside
+    Sequence sequence = makeSequence("optimize", 9);
+    setStep(&sequence, 0, 0x111111, 0);
+    setStep(&sequence, 1, 0x111111, 100);
+    setStep(&sequence, 2, 0x111111, 0);
+    setStep(&sequence, 3, 0x111111, 100);
+    setStep(&sequence, 4, 0x111111, 100);
+    setStep(&sequence, 5, 0x222222, 0);
+    // two random steps with the same colors
+    setStep(&sequence, 6, 0x333333, 5);
+    setStep(&sequence, 7, 0x333333, 5);
+    sequence.data[6].mode1 |= 0x01;
+    sequence.data[7].mode1 |= 0x01;
+    setStep(&sequence, 8, 0x444444, 0);
+    sequence.calcDuration();
+    float duration = sequence.getDuration();
+
+    OptimizeStats stats;
+    CHECK(optimizeSequence(&sequence, TEXT_MAX_TICKS, &stats));
+    CHECK(stats.stepsBefore == 9);
+    CHECK(stats.dropped == 4);
+    if (CHECK(sequence.numSteps() == 6)) {
+        CHECK(sequence.data[0].ticks == 99);
+        CHECK(sequence.data[1].ticks == 99);
+        CHECK(sequence.data[2].ticks == 99);
+        CHECK(sequence.data[3].ticks == 3);
+        CHECK(sequence.data[3].getColor1() == 0x111111);
+        CHECK(sequence.data[4].isRandom1() && sequence.data[4].ticks == 5);
+        CHECK(sequence.data[5].isRandom1() && sequence.data[5].ticks == 5);
+    }
+    CHECK(sequence.getDuration() == duration);
+    CHECK(! optimizeSequence(&sequence, TEXT_MAX_TICKS));
+
+    // a loop without duration is left alone
+    Sequence empty = makeSequence("empty", 3);
+    for (int n = 0; n < 3; n++)
+        empty.data[n].ticks = 0;
+    empty.calcDuration();
+    empty.dirty = false;
+    CHECK(! optimizeSequence(&empty, TEXT_MAX_TICKS, &stats));
+    CHECK(empty.numSteps() == 3);
+    CHECK(! empty.dirty);
+}
+
+// card file name of each sequence by short name
+static std::map<std::string, std::string> cardNames(SequenceList *sequences)
+{
+    std::map<std::string, std::string> names;
+    std::vector<CardFile> files = assignCardNames(sequences, false);
+    for (size_t n = 0; n < files.size(); n++)
+        names[sequences->sequence(files[n].index)->getShortName()] = files[n].fileName;
+    return names;
+}
+
+// names that collide after cutting to 8 characters get ~1, ~2 .. with the
+// base cut to fit, 8.3 file names are kept, the list order does not matter
+static void checkCardNames()
+{
+    std::vector<Sequence> list;
+    // not loaded from a file, comes first but loses SEQ.TXT to the file
+    list.push_back(makeSequence("seq", 1));
+    const char *letters = "ABCDEFGHIJK";
+    for (int n = 0; n < 11; n++) {
+        std::string name = std::string("Samename") + letters[n];
+        list.push_back(makeSequence(name.c_str(), 1));
+    }
+    Sequence loaded = makeSequence("loaded", 1);
+    loaded.setFileName("seq.txt");
+    list.push_back(loaded);
+
+    SequenceList sequences;
+    for (size_t n = 0; n < list.size(); n++)
+        sequences.addSequence(list[n]);
+    std::map<std::string, std::string> names = cardNames(&sequences);
+    CHECK(names["loaded"] == "SEQ.TXT");
+    CHECK(names["seq"] == "SEQ~1.TXT");
+    CHECK(names["SamenameA"] == "SAMENAME.TXT");
+    CHECK(names["SamenameB"] == "SAMENA~1.TXT");
+    CHECK(names["SamenameC"] == "SAMENA~2.TXT");
+    CHECK(names["SamenameJ"] == "SAMENA~9.TXT");
+    CHECK(names["SamenameK"] == "SAMEN~10.TXT");
+
+    SequenceList reversed;
+    for (size_t n = list.size(); n > 0; n--)
+        reversed.addSequence(list[n - 1]);
+    CHECK(cardNames(&reversed) == names);
+}
+
+// indexing a card leaves nothing but the index on it
+static void checkCardIndex(const std::string &dir)
+{
+    std::string card = dir + "/seqcheck.card";
+    std::string path = card + "/SEQ1.TXT";
+    std::string index = card + "/" + SEQX_FILE;
+    std::string manifest = card + ".manifest";
+    mkdir(card.c_str(), 0755);
+    Sequence sequence = makeSequence("card", 3);
+    CHECK(writeSequenceText(&sequence, path.c_str()));
+    CHECK(writeCardIndex(card.c_str()) == 1);
+    struct stat st;
+    CHECK(stat(index.c_str(), &st) == 0);
+    CHECK(stat(manifest.c_str(), &st) != 0);
+    remove(path.c_str());
+    remove(index.c_str());
+    remove(manifest.c_str());
+    rmdir(card.c_str());
+}
+
+// without optimizing, text files still get steps the sketch can read; a
+// long random step can not be split and the sequence stays off the card
+static void checkTextDeploy(const std::string &dir)
+{
+    std::string card = dir + "/seqcheck.deploy";
+    mkdir(card.c_str(), 0755);
+    SequenceList sequences;
+    Sequence sequence = makeSequence("long", 3);
+    sequence.data[1].ticks = 250;
+    sequence.calcDuration();
+    sequences.addSequence(sequence);
+    Sequence random = makeSequence("random", 3);
+    random.data[2].mode1 |= 0x01;
+    random.data[2].ticks = 150;
+    random.calcDuration();
+    sequences.addSequence(random);
+
+    DeployOptions options;
+    options.compiled = false;
+    options.optimize = false;
+    DeployResult result;
+    CHECK(! deployCard(&sequences, card.c_str(), options, &result));
+    CHECK(result.written == 1);
+    CHECK(result.failed == 1);
+    std::string path = card + "/LONG.TXT";
+    Sequence loaded = loadSequenceFile(path.c_str());
+    if (CHECK(loaded.valid) && CHECK(loaded.numSteps() == 5)) {
+        CHECK(loaded.data[1].ticks == 99 && loaded.data[2].ticks == 99 && loaded.data[3].ticks == 52);
+        CHECK(loaded.getDuration() == sequence.getDuration());
+    }
+    struct stat st;
+    CHECK(stat((card + "/RANDOM.TXT").c_str(), &st) != 0);
+    remove(path.c_str());
+    remove((card + "/" + SEQX_FILE).c_str());
+    rmdir(card.c_str());
+}
+
+int main(int argc, char **argv)
+{
+    std::string dir = "/tmp";
+    int opt;
+    while ((opt = getopt(argc, argv, "d:")) != -1) {
+        switch (opt) {
+        case 'd':
+            dir = optarg;
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-d dir]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    checkLongTrace(dir);
+    checkDescriptionLines(dir);
+    checkFormatSequence(dir);
+    checkOptimizer();
+    checkCardNames();
+    checkCardIndex(dir);
+    checkTextDeploy(dir);
+
+    printf("%d checks, %d failed\n", numChecks, numFailed);
+    return numFailed ? 1 : 0;
+}
@@ -0,0 +1,411 @@
+// Command line sequence tool
+//
+// Batch processing of sequence files without a window, for build servers and
+// pre-commit hooks. Directories are expanded to the sequence files in them
+// (.txt and .sqb) and all files are processed in parallel; results are
+// printed in file order.
+//
+// Usage: seqtool-cli <command> [options] <file | directory>...
+//
+//   validate     check that each file loads and plays on the sketch
+//   convert      write text sequences in compiled format (.sqb)
+//   stats        print the steps and duration of each file and the totals
+//   simulate     simulate each file, see seqsim for a single file
+//   optimize     merge runs of identical steps and drop zero duration steps,
+//                files are rewritten in place unless -o is given
+//   deploy       pack all files onto the SD card directory given with -o, with
+//                8.3 names and the card index; unchanged files are skipped
+//
+//   -j <n>       worker threads, default one per core
+//   -o <dir>     output directory of convert and simulate (.trace files),
+//                default next to the input for convert, none for simulate,
+//                in place for optimize; the card directory of deploy
+//   -f txt|sqb   file format of deploy, default sqb
+//   -t <s>       time to simulate in seconds, default 3600
+//   -q           print only problems and the totals
+//
+// Exit status is 1 when any file failed.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include "sequence.h"
+#include "library.h"
+#include "simulation.h"
+#include "deploy.h"
+#include "optimize.h"
+#include "seqformat.h"
+
+enum Command {
+    CMD_VALIDATE,
+    CMD_CONVERT,
+    CMD_STATS,
+    CMD_SIMULATE,
+    CMD_OPTIMIZE,
+    CMD_DEPLOY,
+};
+
+struct Options {
+    Command command;
+    int numThreads = 0;
+    const char *outDir = NULL;
+    double seconds = 3600;
+    bool quiet = false;
+    bool compiled = true;
+};
+
+// outcome of one file, printed once all files are done
+struct FileResult {
+    bool failed = false;
+    bool warned = false;
+    std::string text;
+    int numSteps = 0;
+    uint32_t ticks = 0;
+    int stepsSaved = 0;
+};
+
+static bool hasExtension(const char *name, const char *ext)
+{
+    size_t len = strlen(name);
+    size_t extLen = strlen(ext);
+    return (len > extLen) && (strcasecmp(name + len - extLen, ext) == 0);
+}
+
+// sequence files of a directory in name order
+static bool addDirectory(const char *path, std::vector<std::string> *files)
+{
+    DIR *dirp = opendir(path);
+    if (dirp == NULL) {
+        fprintf(stderr, "opendir() failed: %s: %d - %s\n", path, errno, strerror(errno));
+        return false;
+    }
+    std::vector<std::string> names;
+    struct dirent *dp;
+    while ((dp = readdir(dirp)) != NULL) {
+        if (dp->d_name[0] == '.')
+            continue;
+        if (hasExtension(dp->d_name, ".txt") || hasExtension(dp->d_name, SEQB_EXT))
+            names.push_back(dp->d_name);
+    }
+    closedir(dirp);
+    std::sort(names.begin(), names.end());
+    for (size_t n = 0; n < names.size(); n++)
+        files->push_back(std::string(path) + "/" + names[n]);
+    return true;
+}
+
+// path of the output file for input path with the extension replaced
+static std::string outputPath(const char *path, const char *outDir, const char *ext)
+{
+    const char *slash = strrchr(path, '/');
+    const char *name = slash ? slash + 1 : path;
+    std::string out;
+    if (outDir)
+        out = std::string(outDir) + "/";
+    else if (slash)
+        out = std::string(path, slash - path + 1);
+    const char *dot = strrchr(name, '.');
+    out.append(name, dot ? (size_t)(dot - name) : strlen(name));
+    out.append(ext);
+    return out;
+}
+
+static void appendText(FileResult *result, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+static void appendText(FileResult *result, const char *fmt, ...)
+{
+    char buf[512];
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(buf, sizeof(buf), fmt, args);
+    va_end(args);
+    result->text.append(buf);
+}
+
+static void validateFile(const char *path, Sequence *sequence, const Options &options, FileResult *result)
+{
+    bool compiled = hasExtension(path, SEQB_EXT);
+    if (sequence->numSteps() == 0) {
+        appendText(result, "%s: error: no steps\n", path);
+        result->failed = true;
+        return;
+    }
+    if (sequence->endTicks() == 0) {
+        appendText(result, "%s: error: sequence has no duration\n", path);
+        result->failed = true;
+        return;
+    }
+    int zeroSteps = 0;
+    int longSteps = 0;
+    for (int n = 0; n < sequence->numSteps(); n++) {
+        unsigned int ticks = sequence->getStep(n)->ticks;
+        if (ticks == 0)
+            zeroSteps++;
+        else if (! compiled && ticks > TEXT_MAX_TICKS)
+            longSteps++;
+    }
+    if (zeroSteps) {
+        appendText(result, "%s: warning: %d steps of zero duration\n", path, zeroSteps);
+        result->warned = true;
+    }
+    if (longSteps) {
+        // the sketch reads 2 digits of the duration
+        appendText(result, "%s: error: %d steps over %.1f s, convert to %s\n", path, longSteps, TEXT_MAX_TICKS * 0.1, SEQB_EXT);
+        result->failed = true;
+    }
+    if (! result->failed && ! result->warned && ! options.quiet)
+        appendText(result, "%s: ok\n", path);
+}
+
+static void convertFile(const char *path, Sequence *sequence, const Options &options, FileResult *result)
+{
+    if (hasExtension(path, SEQB_EXT)) {
+        if (! options.quiet)
+            appendText(result, "%s: already compiled\n", path);
+        return;
+    }
+    std::string out = outputPath(path, options.outDir, SEQB_EXT);
+    if (! writeSequenceBinary(sequence, out.c_str())) {
+        appendText(result, "%s: error: failed to write %s\n", path, out.c_str());
+        result->failed = true;
+        return;
+    }
+    if (! options.quiet)
+        appendText(result, "%s: wrote %s\n", path, out.c_str());
+}
+
+static void statsFile(const char *path, Sequence *sequence, const Options &options, FileResult *result)
+{
+    if (! options.quiet)
+        appendText(result, "%-40s %-24s %7d steps %9.1f s\n", path, sequence->getShortName(),
+                   result->numSteps, result->ticks * 0.1);
+}
+
+static void simulateFile(const char *path, Sequence *sequence, const Options &options, FileResult *result)
+{
+    SimTrace trace;
+    if (! simulate(sequence, options.seconds, 0, &trace)) {
+        appendText(result, "%s: error: no steps to play\n", path);
+        result->failed = true;
+        return;
+    }
+    if (options.outDir) {
+        std::string out = outputPath(path, options.outDir, ".trace");
+        if (! writeTrace(out.c_str(), trace)) {
+            appendText(result, "%s: error: failed to write %s\n", path, out.c_str());
+            result->failed = true;
+            return;
+        }
+    }
+    if (! options.quiet)
+        appendText(result, "%s: %d step changes, %u loops\n", path, (int)trace.events.size(),
+                   trace.events.empty() ? 0 : trace.events.back().loop + 1);
+}
+
+static void optimizeFile(const char *path, Sequence *sequence, const Options &options, FileResult *result)
+{
+    bool compiled = hasExtension(path, SEQB_EXT);
+    OptimizeStats stats;
+    if (! optimizeSequence(sequence, compiled ? BINARY_MAX_TICKS : TEXT_MAX_TICKS, &stats)) {
+        if (! options.quiet)
+            appendText(result, "%s: nothing to optimize\n", path);
+        return;
+    }
+    std::string out = options.outDir ? outputPath(path, options.outDir, compiled ? SEQB_EXT : ".txt") : std::string(path);
+    bool ok = compiled ? writeSequenceBinary(sequence, out.c_str()) : writeSequenceText(sequence, out.c_str());
+    if (! ok) {
+        appendText(result, "%s: error: failed to write %s\n", path, out.c_str());
+        result->failed = true;
+        return;
+    }
+    result->numSteps = stats.stepsAfter;
+    result->stepsSaved = stats.stepsBefore - stats.stepsAfter;
+    if (! options.quiet)
+        appendText(result, "%s: %d -> %d steps, %d of zero duration dropped, wrote %s\n", path,
+                   stats.stepsBefore, stats.stepsAfter, stats.dropped, out.c_str());
+}
+
+static void processFile(const char *path, const Options &options, FileResult *result)
+{
+    Sequence sequence = loadSequenceFile(path);
+    if (! sequence.valid) {
+        appendText(result, "%s: error: failed to load\n", path);
+        result->failed = true;
+        return;
+    }
+    result->numSteps = sequence.numSteps();
+    result->ticks = sequence.endTicks();
+    switch (options.command) {
+    case CMD_VALIDATE:
+        validateFile(path, &sequence, options, result);
+        break;
+    case CMD_CONVERT:
+        convertFile(path, &sequence, options, result);
+        break;
+    case CMD_STATS:
+        statsFile(path, &sequence, options, result);
+        break;
+    case CMD_SIMULATE:
+        simulateFile(path, &sequence, options, result);
+        break;
+    case CMD_OPTIMIZE:
+        optimizeFile(path, &sequence, options, result);
+        break;
+    case CMD_DEPLOY:
+        break;
+    }
+}
+
+// load all files into one list and pack it onto the card
+static bool deployFiles(const std::vector<std::string> &files, const Options &options)
+{
+    std::vector<Sequence> loaded(files.size());
+    parallelFor(files.size(), options.numThreads, [&](int n) {
+        loaded[n] = loadSequenceFile(files[n].c_str());
+    });
+    SequenceList sequences;
+    // input file of each sequence in the list
+    std::vector<int> source;
+    bool failed = false;
+    for (size_t n = 0; n < loaded.size(); n++) {
+        if (! loaded[n].valid) {
+            printf("%s: error: failed to load\n", files[n].c_str());
+            failed = true;
+            continue;
+        }
+        sequences.addSequence(std::move(loaded[n]));
+        source.push_back(n);
+    }
+    DeployOptions deployOptions;
+    deployOptions.compiled = options.compiled;
+    deployOptions.numThreads = options.numThreads;
+    DeployResult result;
+    failed |= ! deployCard(&sequences, options.outDir, deployOptions, &result);
+    if (! options.quiet) {
+        std::vector<CardFile> cardFiles = assignCardNames(&sequences, options.compiled);
+        for (size_t n = 0; n < cardFiles.size(); n++)
+            printf("%-12s %s\n", cardFiles[n].fileName, files[source[cardFiles[n].index]].c_str());
+    }
+    printf("%d files: %d written, %d unchanged, %d removed, %d failed; %lld steps, %lld before optimizing\n",
+           result.numFiles, result.written, result.skipped, result.removed, result.failed,
+           result.stepsAfter, result.stepsBefore);
+    return ! failed;
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr, "usage: %s validate|convert|stats|simulate|optimize|deploy [-j threads] [-o dir] [-t s] [-f txt|sqb] [-q] <file | directory>...\n", name);
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2) {
+        usage(argv[0]);
+        return 1;
+    }
+    Options options;
+    const char *name = argv[0];
+    const char *command = argv[1];
+    if (strcmp(command, "validate") == 0) {
+        options.command = CMD_VALIDATE;
+    } else if (strcmp(command, "convert") == 0) {
+        options.command = CMD_CONVERT;
+    } else if (strcmp(command, "stats") == 0) {
+        options.command = CMD_STATS;
+    } else if (strcmp(command, "simulate") == 0) {
+        options.command = CMD_SIMULATE;
+    } else if (strcmp(command, "optimize") == 0) {
+        options.command = CMD_OPTIMIZE;
+    } else if (strcmp(command, "deploy") == 0) {
+        options.command = CMD_DEPLOY;
+    } else {
+        usage(argv[0]);
+        return 1;
+    }
+
+    // options follow the command
+    argv++;
+    argc--;
+    int opt;
+    while ((opt = getopt(argc, argv, "j:o:t:f:q")) != -1) {
+        switch (opt) {
+        case 'j':
+            options.numThreads = atoi(optarg);
+            break;
+        case 'o':
+            options.outDir = optarg;
+            break;
+        case 't':
+            options.seconds = atof(optarg);
+            break;
+        case 'f':
+            if (strcmp(optarg, "txt") != 0 && strcmp(optarg, "sqb") != 0) {
+                usage(name);
+                return 1;
+            }
+            options.compiled = (strcmp(optarg, "sqb") == 0);
+            break;
+        case 'q':
+            options.quiet = true;
+            break;
+        default:
+            usage(name);
+            return 1;
+        }
+    }
+    if (optind >= argc || (options.command == CMD_DEPLOY && options.outDir == NULL)) {
+        usage(name);
+        return 1;
+    }
+
+    std::vector<std::string> files;
+    bool failed = false;
+    for (int n = optind; n < argc; n++) {
+        struct stat st;
+        if (stat(argv[n], &st) != 0) {
+            fprintf(stderr, "%s: %s\n", argv[n], strerror(errno));
+            failed = true;
+        } else if (S_ISDIR(st.st_mode)) {
+            failed |= ! addDirectory(argv[n], &files);
+        } else {
+            files.push_back(argv[n]);
+        }
+    }
+
+    if (options.command == CMD_DEPLOY)
+        return (deployFiles(files, options) && ! failed) ? 0 : 1;
+
+    std::vector<FileResult> results(files.size());
+    parallelFor(files.size(), options.numThreads, [&](int n) {
+        processFile(files[n].c_str(), options, &results[n]);
+    });
+
+    int numFailed = 0;
+    int numWarned = 0;
+    long long numSteps = 0;
+    unsigned long long ticks = 0;
+    long long stepsSaved = 0;
+    for (size_t n = 0; n < results.size(); n++) {
+        fputs(results[n].text.c_str(), stdout);
+        numFailed += results[n].failed;
+        numWarned += results[n].warned;
+        numSteps += results[n].numSteps;
+        ticks += results[n].ticks;
+        stepsSaved += results[n].stepsSaved;
+    }
+    printf("%d files, %lld steps, %.1f s; %d failed, %d with warnings\n",
+           (int)files.size(), numSteps, ticks * 0.1, numFailed, numWarned);
+    if (options.command == CMD_OPTIMIZE)
+        printf("%lld steps saved\n", stepsSaved);
+    return (failed || numFailed > 0) ? 1 : 0;
+}
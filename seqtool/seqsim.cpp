@@ -0,0 +1,120 @@
+// Headless sequence simulation
+//
+// Plays a sequence on virtual time, without a window, and writes the step
+// changes as a binary event trace and / or a Chrome trace JSON file (open in
+// chrome://tracing or https://ui.perfetto.dev); see simulation.h. A trace
+// written before can be given instead of a sequence to convert it.
+//
+// Usage: seqsim [options] <sequence file | trace file>
+//
+//   -t <s>       time to simulate in seconds, default 3600
+//   -x <scale>   time scale, 1 is real time, default 0 (as fast as possible)
+//   -o <file>    write the binary event trace
+//   -j <file>    write the Chrome trace JSON
+//
+// Prints a summary of the simulated show.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <chrono>
+#include <algorithm>
+
+#include "simulation.h"
+
+static bool isTraceFile(const char *path)
+{
+    char magic[4];
+    FILE *fp = fopen(path, "rb");
+    if (fp == NULL)
+        return false;
+    bool ok = (fread(magic, sizeof(magic), 1, fp) == 1) &&
+              (magic[0] == SIMT_MAGIC0) && (magic[1] == SIMT_MAGIC1) &&
+              (magic[2] == SIMT_MAGIC2) && (magic[3] == SIMT_MAGIC3);
+    fclose(fp);
+    return ok;
+}
+
+static void printSummary(const SimTrace &trace, double hostSeconds)
+{
+    double seconds = trace.endTicks * 0.1;
+    unsigned int loops = trace.events.empty() ? 0 : trace.events.back().loop + 1;
+    uint32_t shortest = UINT32_MAX;
+    uint32_t longest = 0;
+    int zeroSteps = 0;
+    for (size_t n = 0; n < trace.events.size(); n++) {
+        uint32_t ticks = trace.eventTicks(n);
+        if (ticks == 0) {
+            zeroSteps++;
+            continue;
+        }
+        shortest = std::min(shortest, ticks);
+        longest = std::max(longest, ticks);
+    }
+    printf("%s: %.1f s simulated, %d step changes, %u loops\n",
+           trace.name, seconds, (int)trace.events.size(), loops);
+    if (longest > 0)
+        printf("steps shown %.1f .. %.1f s, %d of zero duration\n", shortest * 0.1, longest * 0.1, zeroSteps);
+    if (hostSeconds > 0)
+        printf("host time %.3f s (%.0fx real time)\n", hostSeconds, seconds / hostSeconds);
+}
+
+int main(int argc, char **argv)
+{
+    double seconds = 3600;
+    double timeScale = 0;
+    const char *tracePath = NULL;
+    const char *jsonPath = NULL;
+    int opt;
+    while ((opt = getopt(argc, argv, "t:x:o:j:")) != -1) {
+        switch (opt) {
+        case 't':
+            seconds = atof(optarg);
+            break;
+        case 'x':
+            timeScale = atof(optarg);
+            break;
+        case 'o':
+            tracePath = optarg;
+            break;
+        case 'j':
+            jsonPath = optarg;
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-t s] [-x scale] [-o trace] [-j json] <sequence file | trace file>\n", argv[0]);
+            return 1;
+        }
+    }
+    if (optind != argc - 1) {
+        fprintf(stderr, "usage: %s [-t s] [-x scale] [-o trace] [-j json] <sequence file | trace file>\n", argv[0]);
+        return 1;
+    }
+    const char *path = argv[optind];
+
+    SimTrace trace;
+    double hostSeconds = 0;
+    if (isTraceFile(path)) {
+        if (! readTrace(path, &trace))
+            return 1;
+    } else {
+        Sequence sequence = loadSequenceFile(path);
+        if (! sequence.valid) {
+            fprintf(stderr, "failed to load sequence %s\n", path);
+            return 1;
+        }
+        auto hostStart = std::chrono::steady_clock::now();
+        if (! simulate(&sequence, seconds, timeScale, &trace)) {
+            fprintf(stderr, "sequence %s has no steps to play\n", path);
+            return 1;
+        }
+        hostSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - hostStart).count();
+    }
+
+    if (tracePath && ! writeTrace(tracePath, trace))
+        return 1;
+    if (jsonPath && ! writeChromeTrace(jsonPath, trace))
+        return 1;
+    printSummary(trace, hostSeconds);
+    return 0;
+}
@@ -0,0 +1,37 @@
+// Telemetry log decoder
+//
+// Reads a capture of the sketch Serial output and prints the reconstructed
+// step timeline, see telemetry.h. Capture with for example:
+//
+//   stty -F /dev/ttyACM0 115200 raw && cat /dev/ttyACM0 > capture.bin
+//
+// Usage: seqtelemetry [-s] <capture file>
+//
+// -s prints only the summary.
+
+#include <stdio.h>
+#include <string.h>
+
+#include "telemetry.h"
+
+int main(int argc, char **argv)
+{
+    bool summaryOnly = false;
+    int arg = 1;
+    if (arg < argc && strcmp(argv[arg], "-s") == 0) {
+        summaryOnly = true;
+        arg++;
+    }
+    if (arg != argc - 1) {
+        fprintf(stderr, "usage: %s [-s] <capture file>\n", argv[0]);
+        return 1;
+    }
+
+    TelemetryLog log;
+    if (! readTelemetry(argv[arg], &log)) {
+        fprintf(stderr, "no telemetry frames in %s\n", argv[arg]);
+        return 1;
+    }
+    printTimeline(stdout, log, summaryOnly);
+    return 0;
+}
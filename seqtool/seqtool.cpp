@@ -6,6 +6,9 @@
 #include "imgui_impl_glfw.h"
 #include "imgui_impl_opengl3.h"
 #include <stdio.h>
+#include <math.h>
+#include <random>
+#include <algorithm>
 
 // About Desktop OpenGL function loaders:
 //  Modern desktop OpenGL doesn't have a standard portable header file to load OpenGL function pointers.
@@ -37,6 +40,13 @@ using namespace gl;
 #include <GLFW/glfw3.h>
 
 #include "sequence.h"
+#include "library.h"
+#include "player.h"
+#include "timing.h"
+#include "installation.h"
+#include "generator.h"
+#include "deploy.h"
+#include "seqformat.h"
 
 // [Win32] Our example includes a copy of glfw3.lib pre-compiled with VS2010 to maximize ease of testing and compatibility with old VS compilers.
 // To link with VS2010-era libraries, VS2015+ requires linking with legacy_stdio_definitions.lib, which we do using this pragma.
@@ -136,8 +146,10 @@ int main(int, char**)
     //IM_ASSERT(font != NULL);
 
     // Our state
+#ifdef SEQTOOL_DEMO_WINDOWS
     bool show_demo_window = true;
     bool show_another_window = false;
+#endif
     ImVec4 clear_color = ImVec4(0.45f, 0.55f, 0.60f, 1.00f);
 
     char filePathStr[256] = "./sdcard";
@@ -145,9 +157,18 @@ int main(int, char**)
 //    FileName fileName;
 //    Sequence sequence;
 //    bool playing = false;
-    float elapsedTime = 0;
+    Player player;
+    int settleFrames = 2;
+    // wake up the UI as soon as the player moves to the next step
+    player.onStep = [](const PlayerState &) { glfwPostEmptyEvent(); };
     bool show_generator_window = true;
+    bool show_installation_window = true;
+    Installation installation;
+    bool installationRunning = false;
+    // steady clock time (ns) of the installation time 0
+    int64_t installationOrigin = 0;
     SequenceList sequences;
+    LibraryLoader libraryLoader;
 
     // Main loop
     while (!glfwWindowShouldClose(window))
@@ -157,13 +178,50 @@ int main(int, char**)
         // - When io.WantCaptureMouse is true, do not dispatch mouse input data to your main application.
         // - When io.WantCaptureKeyboard is true, do not dispatch keyboard input data to your main application.
         // Generally you may always pass all inputs to dear imgui, and hide them from your application based on those two flags.
-        glfwPollEvents();
+        //
+        // Block until there is something to do: input events, the next step
+        // transition of the running sequence or library loading progress.
+        // A couple of frames are rendered after each wake up to let ImGui
+        // settle (hover states, window sizes).
+        if (settleFrames > 0) {
+            glfwPollEvents();
+            settleFrames--;
+        } else {
+            double timeout = -1;
+            if (libraryLoader.isBusy() || libraryLoader.hasResult()) {
+                timeout = 0.1;
+            } else if (player.isPlaying()) {
+                int64_t next = player.nextTransition;
+                timeout = (next > 0) ? (next - Player::now()) / 1e9 : 0.01;
+                if (timeout < 0)
+                    timeout = 0;
+            } else if (io.WantTextInput) {
+                // text cursor blink
+                timeout = 0.5;
+            }
+            if (installationRunning) {
+                // next step change of any of the controllers
+                uint64_t next = installation.nextEvent();
+                double untilNext = (next == UINT64_MAX) ? 0.1 : (installationOrigin + (int64_t)next * 100000000 - Player::now()) / 1e9;
+                if (untilNext < 0)
+                    untilNext = 0;
+                if (timeout < 0 || untilNext < timeout)
+                    timeout = untilNext;
+            }
+            if (timeout < 0) {
+                glfwWaitEvents();
+            } else {
+                glfwWaitEventsTimeout(timeout);
+            }
+            settleFrames = 2;
+        }
 
         // Start the Dear ImGui frame
         ImGui_ImplOpenGL3_NewFrame();
         ImGui_ImplGlfw_NewFrame();
         ImGui::NewFrame();
 
+#ifdef SEQTOOL_DEMO_WINDOWS
         // 1. Show the big demo window (Most of the sample code is in ImGui::ShowDemoWindow()! You can browse its code to learn more about Dear ImGui!).
         if (show_demo_window)
             ImGui::ShowDemoWindow(&show_demo_window);
@@ -200,6 +258,7 @@ int main(int, char**)
                 show_another_window = false;
             ImGui::End();
         }
+#endif // SEQTOOL_DEMO_WINDOWS
 
         // our sequence handling window
         {
@@ -242,8 +301,13 @@ int main(int, char**)
             }
 #endif
             Sequence *sequence = sequences.selectedSequence();
+            if (sequence && ! sequence->stepsLoaded) {
+                // file went away since the manifest was written
+                sequence = NULL;
+            }
             if (sequence) {
                 // sequence not valid
+                bool stepsEdited = false;
 
                 // fprintf(stderr, "sequence size %d\n", sequence.count());
                 // create step widgets
@@ -261,10 +325,31 @@ int main(int, char**)
                 ImGui::Text("Wait"); ImGui::NextColumn();
                 ImGui::Text("Action"); ImGui::NextColumn();
                 ImGui::Separator();
-                for (int n = 0; n < sequence->numSteps(); n++) {
+                ImGui::Columns(1);
+
+                // steps are shown in a scrolling region of up to 15 rows and
+                // only the visible rows are built, no matter how many steps
+                // the sequence has
+                float rowHeight = ImGui::GetFrameHeightWithSpacing();
+                int visibleRows = sequence->numSteps() < 15 ? sequence->numSteps() : 15;
+                ImGui::BeginChild("##steps", ImVec2(0, visibleRows * rowHeight + ImGui::GetStyle().ItemSpacing.y));
+                ImGui::Columns(5, "listofsteps");
+                ImGui::SetColumnWidth(0, 60);
+                ImGui::SetColumnWidth(1, 60);
+                ImGui::SetColumnWidth(2, 60);
+                ImGui::SetColumnWidth(3, 300);
+                // step removal is deferred until the rows are built
+                int removeStep = -1;
+                ImGuiListClipper clipper;
+                clipper.Begin(sequence->numSteps(), rowHeight);
+                while (clipper.Step())
+                for (int n = clipper.DisplayStart; n < clipper.DisplayEnd; n++) {
                     ImGuiColorEditFlags flags1 = ImGuiColorEditFlags_NoAlpha | ImGuiColorEditFlags_NoInputs | ImGuiColorEditFlags_NoLabel;
                     ImGuiColorEditFlags flags2 = ImGuiColorEditFlags_NoAlpha | ImGuiColorEditFlags_NoInputs | ImGuiColorEditFlags_NoLabel;
-                    Step *step = sequence->getStep(n);
+                    // edit the float view of the packed step, pack it back on change
+                    Step view(*sequence->getStep(n));
+                    Step *step = &view;
+                    bool changed = false;
                     ImGui::PushID(n);
                     ImGui::Text("%04d", n + 1);
                     ImGui::NextColumn();
@@ -273,42 +358,49 @@ int main(int, char**)
                         ImGui::PushStyleVar(ImGuiStyleVar_Alpha, ImGui::GetStyle().Alpha * 0.1f);
                         flags1 |= ImGuiColorEditFlags_NoPicker;
                     }
-                    ImGui::ColorEdit3("color1", (float *)&step->color1, flags1);
+                    changed |= ImGui::ColorEdit3("color1", (float *)&step->color1, flags1);
                     if (step->random1) {
                         ImGui::PopStyleVar();
                     }
                     ImGui::SameLine();
-                    ImGui::Checkbox("###random 1", &step->random1);
+                    changed |= ImGui::Checkbox("###random 1", &step->random1);
                     ImGui::NextColumn();
                     // in case of random color mode disable the color picker and grey out the button
                     if (step->random2) {
                         ImGui::PushStyleVar(ImGuiStyleVar_Alpha, ImGui::GetStyle().Alpha * 0.1f);
                         flags2 |= ImGuiColorEditFlags_NoPicker;
                     }
-                    ImGui::ColorEdit3("color2", (float*)&step->color2, flags2);
+                    changed |= ImGui::ColorEdit3("color2", (float*)&step->color2, flags2);
                     if (step->random2) {
                         ImGui::PopStyleVar();
                     }
                     ImGui::SameLine();
-                    ImGui::Checkbox("##random 2", &step->random2);
+                    changed |= ImGui::Checkbox("##random 2", &step->random2);
                     ImGui::NextColumn();
-                    if (ImGui::SliderFloat("", &step->duration, 1.0f, 9.9f, "%.1f s")) {
-                        // value has changed, recalculate sequence duration
-                        sequence->calcDuration();
+                    bool durationChanged = ImGui::SliderFloat("", &step->duration, 1.0f, 9.9f, "%.1f s");
+                    if (changed || durationChanged) {
+                        // updates sequence duration as well
+                        sequence->setStep(n, step->pack());
+                        stepsEdited = true;
                     }
                     ImGui::NextColumn();
                     if (ImGui::Button("Remove step")) {
                         fprintf(stderr, "sequence: Remove step\n");
-                        sequence->delStep(n);
-                        // sequence has a new step, recalculate sequence duration
-                        sequence->calcDuration();
+                        removeStep = n;
                     }
                     ImGui::NextColumn();
                     ImGui::PopID();
                 }
-                ImGui::Separator();
+                clipper.End();
                 // end multicolumn
                 ImGui::Columns(1);
+                ImGui::EndChild();
+                ImGui::Separator();
+                if (removeStep >= 0) {
+                    // updates sequence duration as well
+                    sequence->delStep(removeStep);
+                    stepsEdited = true;
+                }
 
                 // insert an empty row
                 ImGui::Dummy(ImVec2(10,10));
@@ -357,9 +449,9 @@ int main(int, char**)
                 ImGui::NextColumn();
                 if (ImGui::Button("Add step")) {
                     fprintf(stderr, "sequence: Add step\n");
+                    // updates sequence duration as well
                     sequence->addStep(newStep);
-                    // sequence has a new step, recalculate sequence duration
-                    sequence->calcDuration();
+                    stepsEdited = true;
                 }
                 ImGui::NextColumn();
                 // end multicolumn
@@ -372,54 +464,100 @@ int main(int, char**)
                 // sequence play/stop controls
                 if (ImGui::Button("Start")) {
                     fprintf(stderr, "sequence play: Start\n");
-//                    playing = true;
-                    sequence->startRun();
-                    elapsedTime = 0;
+                    if (player.start(sequence)) {
+                        sequence->startRun();
+                    }
                 }
                 ImGui::SameLine(0, 20);
                 if (ImGui::Button("Stop")) {
                     fprintf(stderr, "sequence play: Stop\n");
-//                    playing = false;
                     sequence->stopRun();
-                    elapsedTime = 0;
+                    player.stop();
                 }
                 ImGui::SameLine(0, 20);
                 if (ImGui::Button("Restart")) {
                     fprintf(stderr, "sequence play: Restart\n");
-//                    playing = false;
                     sequence->stopRun();
-                    elapsedTime = 0;
-                    sequence->startRun();
+                    if (player.start(sequence)) {
+                        sequence->startRun();
+                    }
+                }
+
+                if (stepsEdited) {
+                    sequence->dirty = true;
+                }
+                if (sequence->isRunning() && stepsEdited) {
+                    // player runs on its own copy of the steps; it stops when
+                    // the edit leaves nothing to play
+                    player.update(sequence);
+                    if (! player.isPlaying()) {
+                        sequence->stopRun();
+                    }
                 }
 
                 if (sequence->isRunning()) {
                     ImGuiColorEditFlags flags = ImGuiColorEditFlags_NoAlpha | ImGuiColorEditFlags_NoTooltip | ImGuiColorEditFlags_NoInputs | ImGuiColorEditFlags_NoDragDrop;
-                    elapsedTime += ImGuiIO().DeltaTime;
-                    double runTime = 0;
-                    Step *step = NULL;
-                    int stepIndex = 0;
-                    for (stepIndex = 0; stepIndex < sequence->numSteps(); stepIndex++) {
-                        step = sequence->getStep(stepIndex);
-                        runTime += step->duration;
-                        if (elapsedTime < runTime) {
-                            break;
-                        }
+                    // timing is done by the player thread, only show its state
+                    PlayerState state = player.snapshot();
+                    float elapsedTime = player.elapsed(state);
+                    if (ImGui::SliderFloat("Position", &elapsedTime, 0.0f, sequence->getDuration(), "%.1f s")) {
+                        player.seek(elapsedTime);
                     }
-                    ImGui::Text("Step # %d, elapsed time %.2f / %.2f\n", stepIndex+1, elapsedTime, sequence->getDuration());
-                    ImVec4 color1 = ImColor(step->color1[0], step->color1[1], step->color1[2]);
+                    ImGui::Text("Step # %d, elapsed time %.2f / %.2f, loop %u\n", state.step + 1, elapsedTime, sequence->getDuration(), state.loops + 1);
+                    ImVec4 color1 = ImColor((int)((state.color1 >> 16) & 0xFF), (int)((state.color1 >> 8) & 0xFF), (int)(state.color1 & 0xFF));
                     ImGui::ColorButton("###Panel 1", color1, flags, ImVec2(200, 200));
                     ImGui::SameLine();
-                    ImVec4 color2 = ImColor(step->color2[0], step->color2[1], step->color2[2]);
+                    ImVec4 color2 = ImColor((int)((state.color2 >> 16) & 0xFF), (int)((state.color2 >> 8) & 0xFF), (int)(state.color2 & 0xFF));
                     ImGui::ColorButton("###Panel 2", color2, flags, ImVec2(200, 200));
-                    if (elapsedTime > sequence->getDuration()) {
-                        elapsedTime = 0;
-                        fprintf(stderr, "sequence play: Loop\n");
+                }
+
+                // insert an empty row
+                ImGui::Dummy(ImVec2(10,10));
+                ImGui::Text("Firmware timing");
+                static int timing_model = 0;
+                static bool timing_compiled = true;
+                // the prediction is for these steps; loadSequenceSteps() and
+                // the generator replace the steps of the same sequence
+                static Sequence *timing_sequence = NULL;
+                static const PackedStep *timing_steps = NULL;
+                static int timing_num_steps = 0;
+                static uint32_t timing_end_ticks = 0;
+                static TimingPrediction timing;
+                const char *timing_models[] = { "current", "legacy" };
+                bool timingChanged = ImGui::Combo("Sketch", &timing_model, timing_models, IM_ARRAYSIZE(timing_models));
+                ImGui::SameLine(0, 20);
+                timingChanged |= ImGui::Checkbox("Compiled (.sqb)", &timing_compiled);
+                if (timingChanged || stepsEdited || timing_sequence != sequence || timing_steps != sequence->data.data() ||
+                    timing_num_steps != sequence->numSteps() || timing_end_ticks != sequence->endTicks()) {
+                    // only redone on changes, the model walks all steps
+                    FirmwareModel model = timing_model == 0 ? FirmwareModel::current() : FirmwareModel::legacy();
+                    timing = predictTiming(sequence, model, timing_compiled);
+                    timing_sequence = sequence;
+                    timing_steps = sequence->data.data();
+                    timing_num_steps = sequence->numSteps();
+                    timing_end_ticks = sequence->endTicks();
+                }
+                ImGui::Text("Loop %.3f s, predicted %.3f s, drift %+.1f ms per loop, %+.2f s per hour",
+                            timing.nominalLoop / 1e6, timing.actualLoop / 1e6,
+                            timing.driftPerLoop / 1e3, timing.driftPerHour() / 1e6);
+                ImGui::Text("Largest start error %.1f ms, %d flagged steps", timing.maxLate / 1e3, timing.numFlagged);
+                if (timing.numFlagged > 0) {
+                    ImGui::BeginChild("Flagged steps", ImVec2(0, 100), true);
+                    for (size_t n = 0; n < timing.steps.size(); n++) {
+                        const StepTiming &t = timing.steps[n];
+                        if (t.flags == 0)
+                            continue;
+                        ImGui::Text("Step # %d at %.3f s:%s%s%s", (int)n + 1, t.start / 1e6,
+                                    (t.flags & STEP_TIMING_TOO_SHORT) ? " too short" : "",
+                                    (t.flags & STEP_TIMING_TRUNCATED) ? " over 9.9 s in text" : "",
+                                    (t.flags & STEP_TIMING_LATE) ? " late" : "");
                     }
+                    ImGui::EndChild();
                 }
-            } else {
-                // sequence not valid
-//                playing = false;
-                elapsedTime = 0;
+            }
+            // selecting another sequence stops the running one
+            if (player.isPlaying() && ! (sequence && sequence->isRunning())) {
+                player.stop();
             }
 
             ImGui::End();
@@ -435,15 +573,32 @@ int main(int, char**)
             static bool gen_wait_steps = true;
             static char gen_sequence_name[32] = {0};
             static char gen_sequence_desc[256] = {0};
+            static GeneratorParams gen_params;
             ImGui::Text("Pattern generator number settings");
             ImGui::InputText("Name of sequence (31 char max)", gen_sequence_name, 32);
+            auto generatorName = [](void *, int n, const char **name) { *name = generators[n].name; return true; };
+            ImGui::Combo("Pattern", &gen_params.kind, generatorName, NULL, numGenerators);
             ImGui::InputInt("Number of steps", &gen_num_steps);
+            gen_num_steps = std::max(1, gen_num_steps);
 //            ImGui::InputFloat("Step duration", &gen_step_duration);
-            ImGui::SliderFloat("Step duration", &gen_step_duration, 1.0f, 9.9f, "%.1f s");
+            ImGui::SliderFloat("Step duration", &gen_step_duration, 0.1f, 9.9f, "%.1f s");
             ImGui::Checkbox("Add wait steps", &gen_wait_steps);
             if (gen_wait_steps) {
 //                ImGui::InputFloat("Wait duration", &gen_wait_duration);
-                ImGui::SliderFloat("Wait duration", &gen_wait_duration, 1.0f, 9.9f, "%.1f s");
+                ImGui::SliderFloat("Wait duration", &gen_wait_duration, 0.1f, 9.9f, "%.1f s");
+            }
+            if (generators[gen_params.kind].fn == generateHsvSweep || generators[gen_params.kind].fn == generateRandom) {
+                ImGui::SliderFloat("Saturation", &gen_params.saturation, 0.0f, 1.0f, "%.2f");
+                ImGui::SliderFloat("Value", &gen_params.value, 0.0f, 1.0f, "%.2f");
+            }
+            if (generators[gen_params.kind].fn == generateRandom) {
+                int seed = gen_params.seed;
+                ImGui::InputInt("Seed", &seed);
+                gen_params.seed = seed;
+            }
+            if (generators[gen_params.kind].fn == generateBreathing) {
+                ImGui::InputInt("Steps per breath", &gen_params.period);
+                gen_params.period = std::max(2, gen_params.period);
             }
             ImGui::Text("Description (255 char max)");
             ImGui::InputTextMultiline("##description", gen_sequence_desc, IM_ARRAYSIZE(gen_sequence_desc), ImVec2(-FLT_MIN, ImGui::GetTextLineHeight() * 8));
@@ -536,27 +691,51 @@ int main(int, char**)
                 if (strlen(gen_sequence_name) == 0) {
                     fprintf(stderr, "generating pattern: missing name !\n");
                 } else {
-                    fprintf(stderr, "generating pattern: name '%s', steps %d\n", gen_sequence_name, gen_num_steps);
+                    fprintf(stderr, "generating pattern: name '%s', %s, steps %d\n", gen_sequence_name,
+                            generators[gen_params.kind].name, gen_num_steps);
                     Sequence newSequence(gen_sequence_name);
                     newSequence.appendDescription(gen_sequence_desc);
-                    int step_index = 0;
-                    for (int n = 0; n < gen_num_steps; n++) {
-                        // take a user defined color
-                        step_index = n % 8;
-                        unsigned int c1 = ImColor(step_palette[step_index]);
-                        unsigned char d1 = (unsigned char)(gen_step_duration * 10);
-                        Step newStep = Step(0, c1, 0, c1, d1);
-                        newSequence.addStep(newStep);
-                        if (gen_wait_steps) {
-                            unsigned char d2 = (unsigned char)(gen_wait_duration * 10);
-                            Step newStep = Step(0, 0x00000000, 0, 0x00000000, d2);
-                            newSequence.addStep(newStep);
-                        }
+                    gen_params.numSteps = gen_num_steps;
+                    gen_params.stepTicks = lroundf(gen_step_duration * 10);
+                    gen_params.waitSteps = gen_wait_steps;
+                    gen_params.waitTicks = lroundf(gen_wait_duration * 10);
+                    // ImColor converts to ABGR, the steps take 0xRRGGBB
+                    for (int n = 0; n < GEN_PALETTE_SIZE; n++) {
+                        Step color;
+                        memcpy(color.color1, &step_palette[n], sizeof(color.color1));
+                        gen_params.palette[n] = color.pack().getColor1();
+                    }
+                    generateSteps(gen_params, &newSequence);
+                    sequences.addSequence(std::move(newSequence));
+                }
+            }
+            // long patterns go straight to a compiled sequence file in the
+            // file path, without building the sequence in memory
+            static char gen_file_name[32] = "generated.sqb";
+            ImGui::SameLine(0, 20);
+            if (ImGui::Button("Generate to file")) {
+                if (strlen(gen_sequence_name) == 0 || strlen(gen_file_name) == 0) {
+                    fprintf(stderr, "generating pattern: missing name !\n");
+                } else {
+                    gen_params.numSteps = gen_num_steps;
+                    gen_params.stepTicks = lroundf(gen_step_duration * 10);
+                    gen_params.waitSteps = gen_wait_steps;
+                    gen_params.waitTicks = lroundf(gen_wait_duration * 10);
+                    for (int n = 0; n < GEN_PALETTE_SIZE; n++) {
+                        Step color;
+                        memcpy(color.color1, &step_palette[n], sizeof(color.color1));
+                        gen_params.palette[n] = color.pack().getColor1();
+                    }
+                    char path[512];
+                    snprintf(path, sizeof(path), "%s/%s", filePathStr, gen_file_name);
+                    if (generateFile(gen_params, gen_sequence_name, gen_sequence_desc, path)) {
+                        fprintf(stderr, "generated pattern %s, %d steps to %s\n", generators[gen_params.kind].name, gen_num_steps, path);
                     }
-                    newSequence.calcDuration();
-                    sequences.addSequence(newSequence);
                 }
             }
+            ImGui::SameLine();
+            ImGui::SetNextItemWidth(150);
+            ImGui::InputText("File name", gen_file_name, sizeof(gen_file_name));
 
             ImGui::End();
         }
@@ -570,25 +749,45 @@ int main(int, char**)
             // XXX: make sure it works on all OSes..
             ImGui::InputText("File Path", filePathStr, 256);
 
-            // load sequences from files in file path
+            // load sequences from files in file path, files are parsed in
+            // the background and merged in file name order once all are done
             if (ImGui::Button("Load Files")) {
-                FileList fileList = loadFileList(filePathStr);
-                fprintf(stderr, "file list size %d\n", fileList.count());
-                for (int n = 0; n < fileList.count(); n++) {
-                    // load the file contents
-                    FileName *fn = fileList.getFileName(n);
-                    Sequence newSequence = loadSequence(fn);
-                    newSequence.calcDuration();
-                    if (! sequences.exists(newSequence.getShortName())) {
-                        fprintf(stderr, "adding loaded sequence %s..\n", newSequence.getShortName());
-                        sequences.addSequence(newSequence);
-                    } else {
-                        fprintf(stderr, "not adding sequence, already exists %s..\n", newSequence.getShortName());
-                    }
-//                    playing = false;
-//                    elapsedTime = 0;
+                if (! libraryLoader.start(filePathStr)) {
+                    fprintf(stderr, "library load already in progress\n");
                 }
             }
+            if (libraryLoader.isBusy()) {
+                ImGui::SameLine();
+                ImGui::Text("Loading %d / %d ..", (int)libraryLoader.numLoaded, (int)libraryLoader.numFiles);
+            } else if (libraryLoader.hasResult()) {
+                libraryLoader.merge(&sequences);
+            }
+            // index of the sequence files for browsing on the sketch
+            ImGui::SameLine();
+            if (ImGui::Button("Write Index")) {
+                writeCardIndex(filePathStr);
+            }
+
+            // export all sequences onto the SD card, with 8.3 names and the index
+            static char cardPathStr[256] = "";
+            static DeployOptions deployOptions;
+            static DeployResult deployResult;
+            static bool deployed = false;
+            ImGui::InputText("Card Path", cardPathStr, 256);
+            if (ImGui::Button("Deploy to Card") && cardPathStr[0] != '\0') {
+                deployCard(&sequences, cardPathStr, deployOptions, &deployResult);
+                deployed = true;
+            }
+            ImGui::SameLine();
+            ImGui::Checkbox("Compiled", &deployOptions.compiled);
+            ImGui::SameLine();
+            ImGui::Checkbox("Optimize", &deployOptions.optimize);
+            if (deployed) {
+                ImGui::SameLine();
+                ImGui::Text("%d files: %d written, %d unchanged, %d removed, %d failed; %lld of %lld steps", deployResult.numFiles,
+                            deployResult.written, deployResult.skipped, deployResult.removed, deployResult.failed,
+                            deployResult.stepsAfter, deployResult.stepsBefore);
+            }
 
             ImGui::Text("Number of sequences: %d", sequences.count());
             ImGui::Columns(5, "sequences");
@@ -605,22 +804,27 @@ int main(int, char**)
                 char label[32];
                 sprintf(label, "%04d", n + 1);
                 if (ImGui::Selectable(label, sequences.selectedIndex() == n, ImGuiSelectableFlags_SpanAllColumns)) {
+                    // sequences restored from the manifest have no steps yet
+                    if (! loadSequenceSteps(seq)) {
+                        fprintf(stderr, "failed to load steps of sequence %s\n", seq->getShortName());
+                    }
                     sequences.selectSequence(n);
                     fprintf(stderr, "Selected sequence %s, number of steps %d\n", seq->getShortName(), seq->numSteps());
                     for (int m = 0; m < seq->numSteps(); m++) {
-                        Step *step = seq->getStep(m);
+                        PackedStep *step = seq->getStep(m);
                         fprintf(stderr, "panel1: mode %d, color %06X | panel2: mode %d, color %06X | wait %f s\n",
                                 step->mode1,
-                                (unsigned int)ImColor(step->color1[0], step->color1[1], step->color1[2], .0f),
+                                step->getColor1(),
                                 step->mode2,
-                                (unsigned int)ImColor(step->color2[0], step->color2[1], step->color2[2], .0f),
-                                step->duration);
+                                step->getColor2(),
+                                step->getDuration());
                     }
                 }
                 ImGui::NextColumn();
-                ImGui::Text("%s", seq->getShortName());
+                // unsaved changes
+                ImGui::Text("%s%s", seq->getShortName(), seq->dirty ? " *" : "");
                 ImGui::NextColumn();
-                ImGui::Text("%d", seq->numSteps());
+                ImGui::Text("%d", seq->getStepCount());
                 ImGui::NextColumn();
                 ImGui::Text("%.2f s", seq->duration);
                 ImGui::NextColumn();
@@ -641,6 +845,125 @@ int main(int, char**)
                 ImGui::TextWrapped("Sequence not selected..");
             }
 
+            // convert the selected sequence to compiled (binary) format, the
+            // file is placed in the file path next to the text files
+            if (selectedSeq && selectedSeq->stepsLoaded && ImGui::Button("Compile")) {
+                char name[32];
+                strncpy(name, strlen(selectedSeq->getFileName()) ? selectedSeq->getFileName() : selectedSeq->getShortName(), 31);
+                name[31] = '\0';
+                char *ext = strrchr(name, '.');
+                if (ext)
+                    *ext = '\0';
+                char path[512];
+                snprintf(path, sizeof(path), "%s/%s%s", filePathStr, name, SEQB_EXT);
+                if (writeSequenceBinary(selectedSeq, path)) {
+                    fprintf(stderr, "compiled sequence %s to %s\n", selectedSeq->getShortName(), path);
+                }
+            }
+            // write edited and generated sequences back, new ones go to the
+            // file path as text files
+            if (selectedSeq && selectedSeq->dirty) {
+                if (selectedSeq->stepsLoaded) {
+                    ImGui::SameLine();
+                }
+                if (ImGui::Button("Save")) {
+                    saveSequence(&sequences, sequences.selectedIndex(), filePathStr);
+                }
+            }
+            int numDirty = 0;
+            for (int n = 0; n < sequences.count(); n++) {
+                numDirty += sequences.sequence(n)->dirty;
+            }
+            if (numDirty > 0) {
+                if (selectedSeq && (selectedSeq->stepsLoaded || selectedSeq->dirty)) {
+                    ImGui::SameLine();
+                }
+                char label[32];
+                snprintf(label, sizeof(label), "Save all (%d)", numDirty);
+                if (ImGui::Button(label)) {
+                    saveDirtySequences(&sequences, filePathStr);
+                }
+            }
+
+            ImGui::End();
+        }
+
+        // installation window: many controllers, each playing a sequence
+        if (show_installation_window)
+        {
+            ImGui::Begin("Installation", &show_installation_window);
+            static int inst_num_panels = 1000;
+            static bool inst_random_phase = true;
+            ImGui::InputInt("Number of panels", &inst_num_panels, 2, 100);
+            inst_num_panels = std::max(2, std::min(10000, inst_num_panels));
+            ImGui::Checkbox("Random phase", &inst_random_phase);
+            // the loaded sequences are assigned to the controllers in turn
+            if (ImGui::Button("Build")) {
+                installation.clear();
+                installationRunning = false;
+                std::vector<int> seqs;
+                for (int n = 0; n < sequences.count(); n++) {
+                    Sequence *seq = sequences.sequence(n);
+                    if (! seq->valid || ! loadSequenceSteps(seq))
+                        continue;
+                    int index = installation.addSequence(seq);
+                    if (index >= 0)
+                        seqs.push_back(index);
+                }
+                if (seqs.size() > 0) {
+                    // same phases on every build
+                    std::mt19937 random(1);
+                    for (int c = 0; c < inst_num_panels / 2; c++) {
+                        int index = seqs[c % seqs.size()];
+                        installation.addController(index, inst_random_phase ? random() % installation.seqTicks[index] : 0);
+                    }
+                    installation.reset();
+                    installation.evaluate();
+                }
+                fprintf(stderr, "installation: %d controllers, %d sequences\n", installation.numControllers(), (int)seqs.size());
+            }
+            ImGui::SameLine(0, 20);
+            if (ImGui::Button("Start") && installation.numControllers() > 0) {
+                installation.reset();
+                installationOrigin = Player::now();
+                installationRunning = true;
+            }
+            ImGui::SameLine(0, 20);
+            if (ImGui::Button("Stop")) {
+                installationRunning = false;
+            }
+
+            if (installationRunning) {
+                installation.advanceTo((Player::now() - installationOrigin) / 100000000);
+                installation.evaluate();
+            }
+            ImGui::Text("%d panels, %d sequences, time %.1f s, %llu step changes, %.1f FPS",
+                        installation.numPanels(), (int)installation.seqFirst.size(), installation.now * 0.1,
+                        (unsigned long long)installation.changes, io.Framerate);
+
+            // grid of panels, the cell size fits all of them in the window
+            int numPanels = installation.numPanels();
+            if (numPanels > 0) {
+                ImVec2 avail = ImGui::GetContentRegionAvail();
+                float cell = floorf(sqrtf(std::max(avail.x, 100.0f) * std::max(avail.y, 100.0f) / numPanels));
+                cell = std::max(2.0f, std::min(32.0f, cell));
+                int columns = std::max(1, (int)(std::max(avail.x, 100.0f) / cell));
+                // even number of columns, the two panels of a controller side by side
+                columns = std::max(2, columns & ~1);
+                int rows = (numPanels + columns - 1) / columns;
+                ImVec2 origin = ImGui::GetCursorScreenPos();
+                ImDrawList *drawList = ImGui::GetWindowDrawList();
+                float gap = cell > 4.0f ? 1.0f : 0.0f;
+                for (int n = 0; n < numPanels; n++) {
+                    int c = n / 2;
+                    unsigned int color = (n & 1) ? installation.panelColor2[c] : installation.panelColor1[c];
+                    ImVec2 p0(origin.x + (n % columns) * cell, origin.y + (n / columns) * cell);
+                    ImVec2 p1(p0.x + cell - gap, p0.y + cell - gap);
+                    drawList->AddRectFilled(p0, p1, IM_COL32((color >> 16) & 0xFF, (color >> 8) & 0xFF, color & 0xFF, 0xFF));
+                }
+                ImGui::Dummy(ImVec2(columns * cell, rows * cell));
+            }
+
             ImGui::End();
         }
 
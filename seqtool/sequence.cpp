@@ -3,8 +3,22 @@
 #include <dirent.h>
 #include <errno.h>
 #include <ctype.h>
+#include <strings.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifndef _WIN32
+#include <sys/mman.h>
+#else
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#endif
 
 #include "sequence.h"
+#include "seqformat.h"
+
+static_assert(sizeof(PackedStep) == sizeof(SeqbStep), "PackedStep must match SeqbStep layout");
 
 
 static int readDirectory(const char *filePath, FileList *fileList);
@@ -23,7 +37,7 @@ FileList loadFileList(const char *filePath)
     return fileList;
 }
 
-Sequence loadSequence(const FileName *fileName)
+Sequence loadSequenceStdio(const FileName *fileName)
 {
     fprintf(stderr, "User supplied file name: '%s'\n", fileName->name);
 
@@ -121,7 +135,7 @@ Sequence loadSequence(const FileName *fileName)
                 fprintf(stderr, "data line invalid! nconv %d, buf: '%s'\n", nconv, buf);
                 assert(nconv == 5);
             }
-            sequence.addStep(Step(mode1, color1, mode2, color2, wait));
+            sequence.addStep(PackedStep(mode1, color1, mode2, color2, wait));
         }
 
     } while (!feof(fp));
@@ -136,6 +150,568 @@ Sequence loadSequence(const FileName *fileName)
     return sequence;
 }
 
+// Read only view of the whole file contents. Uses mmap() where available,
+// otherwise the file is read into a heap buffer in one go.
+struct FileMap {
+    const char *data = NULL;
+    size_t size = 0;
+    bool mapped = false;
+};
+
+static bool mapFile(const char *path, FileMap *map)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        fprintf(stderr, "open() failed: %d %s\n", errno, strerror(errno));
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == -1) {
+        fprintf(stderr, "fstat() failed: %d %s\n", errno, strerror(errno));
+        close(fd);
+        return false;
+    }
+    map->size = st.st_size;
+    if (map->size == 0) {
+        // nothing to map, empty sequence
+        close(fd);
+        return true;
+    }
+#ifndef _WIN32
+    void *p = mmap(NULL, map->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (p != MAP_FAILED) {
+        // file is read front to back exactly once
+        madvise(p, map->size, MADV_SEQUENTIAL);
+        map->data = (const char *)p;
+        map->mapped = true;
+        close(fd);
+        return true;
+    }
+    fprintf(stderr, "mmap() failed: %d %s, falling back to read()\n", errno, strerror(errno));
+#endif
+    char *buf = (char *)malloc(map->size);
+    size_t n = 0;
+    while (buf && n < map->size) {
+        ssize_t r = read(fd, buf + n, map->size - n);
+        if (r <= 0) {
+            fprintf(stderr, "read() failed: %d %s\n", errno, strerror(errno));
+            free(buf);
+            buf = NULL;
+            break;
+        }
+        n += r;
+    }
+    close(fd);
+    map->data = buf;
+    return (buf != NULL);
+}
+
+static void unmapFile(FileMap *map)
+{
+    if (map->data == NULL)
+        return;
+#ifndef _WIN32
+    if (map->mapped) {
+        munmap((void *)map->data, map->size);
+        map->data = NULL;
+        return;
+    }
+#endif
+    free((void *)map->data);
+    map->data = NULL;
+}
+
+static inline bool isBlank(char c)
+{
+    return (c == ' ') || (c == '\t') || (c == '\r');
+}
+
+static inline int hexValue(char c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    return -1;
+}
+
+// Parse hex number at p, skipping leading blanks; same as "%X" of sscanf().
+// Returns pointer past the last digit or NULL if no digits were found.
+static inline const char *parseHexField(const char *p, const char *e, unsigned int *value)
+{
+    while (p < e && isBlank(*p))
+        p++;
+    unsigned int v = 0;
+    const char *s = p;
+    int d;
+    while (p < e && (d = hexValue(*p)) >= 0) {
+        v = (v << 4) | d;
+        p++;
+    }
+    if (p == s)
+        return NULL;
+    *value = v;
+    return p;
+}
+
+// Parse decimal number at p, skipping leading blanks; same as "%u" of sscanf().
+static inline const char *parseDecField(const char *p, const char *e, unsigned int *value)
+{
+    while (p < e && isBlank(*p))
+        p++;
+    unsigned int v = 0;
+    const char *s = p;
+    while (p < e && *p >= '0' && *p <= '9') {
+        v = v * 10 + (*p - '0');
+        p++;
+    }
+    if (p == s)
+        return NULL;
+    *value = v;
+    return p;
+}
+
+// Data line : XX AAAAAA YY BBBBBB CC
+static bool parseDataLine(const char *p, const char *e, Sequence *sequence)
+{
+    unsigned int mode1, color1, mode2, color2, wait;
+    if ((p = parseHexField(p, e, &mode1)) == NULL)
+        return false;
+    if ((p = parseHexField(p, e, &color1)) == NULL)
+        return false;
+    if ((p = parseHexField(p, e, &mode2)) == NULL)
+        return false;
+    if ((p = parseHexField(p, e, &color2)) == NULL)
+        return false;
+    if ((p = parseDecField(p, e, &wait)) == NULL)
+        return false;
+    // construct the step in place, narrowing as "%hhX" / "%hhu" would
+    sequence->data.emplace_back((unsigned char)mode1, color1, (unsigned char)mode2, color2, (unsigned char)wait);
+    return true;
+}
+
+// Comment line: strip trailing whitespace and leading blanks / '#'. Short
+// name always keeps at least one character, description can end up empty.
+static void parseCommentLine(const char *s, const char *e, bool isName, char *out, size_t outSize)
+{
+    while ((e > s) && isspace(*(e - 1)))
+        e--;
+    const char *last = isName ? (e - 1) : e;
+    while (s < last) {
+        if ((! isblank(*s)) && ! (*s == '#')) break;
+        s++;
+    }
+    size_t n = e - s;
+    if (n > outSize - 1)
+        n = outSize - 1;
+    memcpy(out, s, n);
+    out[n] = '\0';
+}
+
+static bool isBinarySequence(const FileMap *map)
+{
+    return (map->size >= sizeof(SeqbHeader)) &&
+           (map->data[0] == SEQB_MAGIC0) && (map->data[1] == SEQB_MAGIC1) &&
+           (map->data[2] == SEQB_MAGIC2) && (map->data[3] == SEQB_MAGIC3);
+}
+
+// Compiled sequence: fixed size header followed by fixed size step records.
+static bool parseBinary(const FileMap *map, const char *name, Sequence *sequence)
+{
+    SeqbHeader header;
+    memcpy(&header, map->data, sizeof(header));
+    if ((header.version != SEQB_VERSION) ||
+        (header.stepSize != sizeof(SeqbStep)) ||
+        (header.headerSize != sizeof(SeqbHeader)) ||
+        (map->size < header.headerSize + (size_t)header.numSteps * header.stepSize)) {
+        fprintf(stderr, "%s: invalid compiled sequence\n", name);
+        return false;
+    }
+    header.name[SEQB_NAME_LEN - 1] = '\0';
+    header.description[SEQB_DESC_LEN - 1] = '\0';
+    sequence->setShortName(header.name);
+    sequence->appendDescription(header.description);
+
+    // records have the same layout as the packed steps
+    sequence->data.resize(header.numSteps);
+    memcpy(sequence->data.data(), map->data + header.headerSize, (size_t)header.numSteps * sizeof(SeqbStep));
+    return true;
+}
+
+void initBinaryHeader(SeqbHeader *header, const char *name, const char *description, uint32_t numSteps, uint32_t duration)
+{
+    memset(header, 0, sizeof(*header));
+    header->magic[0] = SEQB_MAGIC0;
+    header->magic[1] = SEQB_MAGIC1;
+    header->magic[2] = SEQB_MAGIC2;
+    header->magic[3] = SEQB_MAGIC3;
+    header->version = SEQB_VERSION;
+    header->stepSize = sizeof(SeqbStep);
+    header->headerSize = sizeof(SeqbHeader);
+    header->numSteps = numSteps;
+    header->duration = duration;
+    strncpy(header->name, name, SEQB_NAME_LEN - 1);
+    strncpy(header->description, description, SEQB_DESC_LEN - 1);
+}
+
+FILE *openTempFile(const char *path, std::string *tmpPath)
+{
+    *tmpPath = std::string(path) + ".tmp";
+    FILE *fp = fopen(tmpPath->c_str(), "wb");
+    if (fp == NULL) {
+        fprintf(stderr, "fopen() failed: %d %s\n", errno, strerror(errno));
+    }
+    return fp;
+}
+
+// rename() does not replace an existing file on Windows
+static bool replaceFile(const char *from, const char *to)
+{
+#ifdef _WIN32
+    if (! MoveFileExA(from, to, MOVEFILE_REPLACE_EXISTING)) {
+        fprintf(stderr, "MoveFileEx() failed: %s: %lu\n", to, (unsigned long)GetLastError());
+        return false;
+    }
+    return true;
+#else
+    if (rename(from, to) != 0) {
+        fprintf(stderr, "rename() failed: %s: %d %s\n", to, errno, strerror(errno));
+        return false;
+    }
+    return true;
+#endif
+}
+
+bool commitTempFile(FILE *fp, bool ok, const std::string &tmpPath, const char *path)
+{
+    ok = (fclose(fp) == 0) && ok;
+    if (! ok)
+        fprintf(stderr, "failed to write %s: %d %s\n", path, errno, strerror(errno));
+    if (! ok || ! replaceFile(tmpPath.c_str(), path)) {
+        remove(tmpPath.c_str());
+        return false;
+    }
+    return true;
+}
+
+// Where the writers put the file contents: a file, or a string for
+// formatSequence().
+struct Output {
+    FILE *fp = NULL;
+    std::string *str = NULL;
+
+    bool write(const void *data, size_t size) {
+        if (str) {
+            str->append((const char *)data, size);
+            return true;
+        }
+        return fwrite(data, 1, size, fp) == size;
+    }
+};
+
+static bool putBinary(Sequence *sequence, Output *out)
+{
+    uint32_t duration = 0;
+    for (int n = 0; n < sequence->numSteps(); n++) {
+        duration += sequence->getStep(n)->ticks;
+    }
+    SeqbHeader header;
+    initBinaryHeader(&header, sequence->getShortName(), sequence->getDescription(), sequence->numSteps(), duration);
+
+    // packed steps are written as they are
+    return out->write(&header, sizeof(header)) &&
+           out->write(sequence->data.data(), sizeof(PackedStep) * sequence->data.size());
+}
+
+bool writeSequenceBinary(Sequence *sequence, const char *path)
+{
+    std::string tmpPath;
+    FILE *fp = openTempFile(path, &tmpPath);
+    if (fp == NULL)
+        return false;
+    Output out;
+    out.fp = fp;
+    bool ok = putBinary(sequence, &out);
+    return commitTempFile(fp, ok, tmpPath, path);
+}
+
+// output buffer of the text writer; flushed when the next line may not fit
+#define WRITE_BUFFER_SIZE   (1 << 20)
+#define WRITE_LINE_MAX      300
+// description is written as comment lines of up to this many characters
+#define WRITE_DESC_WIDTH    76
+
+static const char hexDigits[] = "0123456789ABCDEF";
+
+static inline char *putHex(char *p, unsigned char v)
+{
+    p[0] = hexDigits[v >> 4];
+    p[1] = hexDigits[v & 0x0F];
+    return p + 2;
+}
+
+static inline char *putColor(char *p, const unsigned char *color)
+{
+    p = putHex(p, color[0]);
+    p = putHex(p, color[1]);
+    return putHex(p, color[2]);
+}
+
+// at least 2 digits, as the sketch reads them
+static inline char *putTicks(char *p, unsigned int ticks)
+{
+    if (ticks >= 100)
+        *p++ = '0' + ticks / 100;
+    p[0] = '0' + (ticks / 10) % 10;
+    p[1] = '0' + ticks % 10;
+    return p + 2;
+}
+
+// Data line : XX AAAAAA YY BBBBBB CC
+static inline char *putDataLine(char *p, const PackedStep *step)
+{
+    p = putHex(p, step->mode1);
+    *p++ = ' ';
+    p = putColor(p, step->color1);
+    *p++ = ' ';
+    p = putHex(p, step->mode2);
+    *p++ = ' ';
+    p = putColor(p, step->color2);
+    *p++ = ' ';
+    p = putTicks(p, step->ticks);
+    *p++ = '\n';
+    return p;
+}
+
+// Comment lines of text, broken at spaces.
+static char *putComment(char *p, const char *s, size_t len)
+{
+    while (len > 0) {
+        size_t n = len;
+        size_t skip = 0;
+        if (n > WRITE_DESC_WIDTH) {
+            n = WRITE_DESC_WIDTH;
+            while (n > 0 && s[n] != ' ')
+                n--;
+            if (n == 0)
+                n = WRITE_DESC_WIDTH;
+            else
+                skip = 1;
+        }
+        *p++ = '#';
+        *p++ = ' ';
+        memcpy(p, s, n);
+        p += n;
+        *p++ = '\n';
+        s += n + skip;
+        len -= n + skip;
+    }
+    return p;
+}
+
+// Description as comment lines; a multi line description from the editor
+// gets a comment line per line, without '\r'. The loader joins the lines
+// with a space again.
+static char *putDescription(char *p, const char *s)
+{
+    char line[256];
+    while (*s) {
+        size_t len = 0;
+        for (; *s && *s != '\n'; s++) {
+            if (*s != '\r' && len < sizeof(line))
+                line[len++] = *s;
+        }
+        if (*s == '\n')
+            s++;
+        p = putComment(p, line, len);
+    }
+    return p;
+}
+
+// path is only used in messages
+static bool putText(Sequence *sequence, Output *out, const char *path)
+{
+    std::vector<char> buf(WRITE_BUFFER_SIZE);
+    char *start = buf.data();
+    char *end = start + buf.size() - WRITE_LINE_MAX;
+    char *p = start;
+
+    // name and description fit the buffer, flushes are only needed for steps
+    p += snprintf(p, WRITE_LINE_MAX, "# %s\n", sequence->getShortName());
+    p = putDescription(p, sequence->getDescription());
+    bool ok = true;
+    int longSteps = 0;
+    for (int n = 0; ok && n < sequence->numSteps(); n++) {
+        const PackedStep *step = sequence->getStep(n);
+        if (step->ticks > TEXT_MAX_TICKS)
+            longSteps++;
+        p = putDataLine(p, step);
+        if (p >= end) {
+            ok = out->write(start, p - start);
+            p = start;
+        }
+    }
+    ok = ok && out->write(start, p - start);
+    if (longSteps > 0) {
+        fprintf(stderr, "%s: %d steps longer than 9.9 s, the sketch reads only 2 digits\n", path, longSteps);
+    }
+    return ok;
+}
+
+bool writeSequenceText(Sequence *sequence, const char *path)
+{
+    std::string tmpPath;
+    FILE *fp = openTempFile(path, &tmpPath);
+    if (fp == NULL)
+        return false;
+    Output out;
+    out.fp = fp;
+    bool ok = putText(sequence, &out, path);
+    return commitTempFile(fp, ok, tmpPath, path);
+}
+
+bool formatSequence(Sequence *sequence, bool compiled, std::string *out)
+{
+    out->clear();
+    Output output;
+    output.str = out;
+    return compiled ? putBinary(sequence, &output) : putText(sequence, &output, sequence->getShortName());
+}
+
+bool writeSequence(Sequence *sequence, const char *path)
+{
+    size_t len = strlen(path);
+    size_t extLen = strlen(SEQB_EXT);
+    if (len > extLen && strcasecmp(path + len - extLen, SEQB_EXT) == 0)
+        return writeSequenceBinary(sequence, path);
+    return writeSequenceText(sequence, path);
+}
+
+// path is the file to load, dir and name go into the sequence
+static Sequence loadMapped(const char *path, const char *dir, const char *name)
+{
+    char buf[256];
+    FileMap map;
+    if (! mapFile(path, &map)) {
+        fprintf(stderr, "failed to load %s\n", path);
+        return Sequence();
+    }
+
+    // make short name same as filename for now; will be replaced if short name
+    // is found in the file while parsing
+    Sequence sequence(name, name);
+    sequence.setFilePath(dir);
+    bool hasShortName = false;
+
+    if (isBinarySequence(&map)) {
+        bool ok = parseBinary(&map, name, &sequence);
+        unmapFile(&map);
+        if (! ok)
+            return Sequence();
+        sequence.calcDuration();
+        sequence.valid = true;
+        return sequence;
+    }
+
+    const char *p = map.data;
+    const char *end = map.data + map.size;
+    // every data line becomes a step; size the step storage once up front
+    size_t nlines = 1;
+    for (const char *q = p; q < end && (q = (const char *)memchr(q, '\n', end - q)) != NULL; q++)
+        nlines++;
+    sequence.data.reserve(nlines);
+
+    while (p < end) {
+        const char *eol = (const char *)memchr(p, '\n', end - p);
+        if (eol == NULL)
+            eol = end;
+        const char *s = p;
+        p = eol + 1;
+
+        // skip blank lines
+        while (s < eol && isBlank(*s))
+            s++;
+        if (s == eol)
+            continue;
+
+        if (*s == '#') {
+            // first commented line is short sequence name, other commented
+            // lines are considered description
+            parseCommentLine(s, eol, ! hasShortName, buf, sizeof(buf));
+            if (hasShortName == false) {
+                sequence.setShortName(buf);
+                hasShortName = true;
+            } else if (strlen(buf) > 0) {
+                sequence.appendDescription(buf);
+            }
+        } else if (! parseDataLine(s, eol, &sequence)) {
+            fprintf(stderr, "%s: data line %d invalid: '%.*s'\n", name,
+                    sequence.numSteps() + 1, (int)(eol - s), s);
+            unmapFile(&map);
+            return Sequence();
+        }
+    }
+    unmapFile(&map);
+
+    // calculate complete sequence duration
+    sequence.calcDuration();
+    // mark sequence as usable by ui
+    sequence.valid = true;
+    return sequence;
+}
+
+Sequence loadSequence(const FileName *fileName)
+{
+    char buf[256];
+    snprintf(buf, sizeof(buf), "%s/%s", fileName->path, fileName->name);
+    return loadMapped(buf, fileName->path, fileName->name);
+}
+
+Sequence loadSequenceFile(const char *path)
+{
+    const char *slash = strrchr(path, '/');
+    const char *name = slash ? slash + 1 : path;
+    std::string dir = slash ? std::string(path, slash - path) : std::string(".");
+    return loadMapped(path, dir.c_str(), name);
+}
+
+bool loadSequenceSteps(Sequence *sequence)
+{
+    if (sequence->stepsLoaded)
+        return true;
+    FileName fileName(sequence->getFilePath(), sequence->getFileName());
+    Sequence loaded = loadSequence(&fileName);
+    if (! loaded.valid)
+        return false;
+    // keep the run state, everything else comes from the file
+    loaded.running = sequence->running;
+    *sequence = std::move(loaded);
+    return true;
+}
+
+uint64_t hashData(const void *data, size_t size)
+{
+    const unsigned char *p = (const unsigned char *)data;
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (size_t n = 0; n < size; n++) {
+        h ^= p[n];
+        h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
+bool hashFile(const char *path, uint64_t *hash)
+{
+    FileMap map;
+    if (! mapFile(path, &map))
+        return false;
+    *hash = hashData(map.data, map.size);
+    unmapFile(&map);
+    return true;
+}
+
 static int readDirectory(const char *filePath, FileList *fileList)
 {
     DIR *dirp = opendir(filePath);
@@ -159,6 +735,10 @@ static int readDirectory(const char *filePath, FileList *fileList)
             // end of the directory
             break;
         }
+        // the SD card index lists the sequence files, it is not one
+        if (strcasecmp(dp->d_name, SEQX_FILE) == 0) {
+            continue;
+        }
         if ((strncmp(dp->d_name, ".", 1) != 0) && (strncmp(dp->d_name, "..", 2) != 0)) {
             fprintf(stderr, "found file '%s'\n", dp->d_name);
             fileList->add(filePath, dp->d_name);
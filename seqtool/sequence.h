@@ -2,9 +2,14 @@
 #define SEQUENCE_H
 
 #include <vector>
+#include <string>
+#include <unordered_map>
+#include <algorithm>
 
+#include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <stdint.h>
 
 #include "imgui.h"
 
@@ -32,6 +37,8 @@ struct FileName {
 //        setName(name_);
         strncpy(path, path_, 32);
         strncpy(name, name_, 32);
+        path[31] = '\0';
+        name[31] = '\0';
     }
     ~FileName() {
 //        if (name) free(name);
@@ -78,6 +85,53 @@ struct FileList {
     }
 };
 
+// Step as kept in a sequence; same information as a data line
+// XX AAAAAA YY BBBBBB CC in 9 bytes. Layout matches SeqbStep of the
+// compiled sequence format.
+struct PackedStep {
+    unsigned char mode1 = 0;
+    unsigned char color1[3] = { 0, 0, 0 };  // R, G, B
+    unsigned char mode2 = 0;
+    unsigned char color2[3] = { 0, 0, 0 };  // R, G, B
+    // duration in 100 ms ticks
+    unsigned char ticks = 10;
+
+    PackedStep() {}
+
+    PackedStep(unsigned char mode1_, unsigned int color1_, unsigned char mode2_, unsigned int color2_, unsigned int ticks_) {
+        mode1 = mode1_;
+        setColor(color1, color1_);
+        mode2 = mode2_;
+        setColor(color2, color2_);
+        ticks = ticks_;
+    }
+
+    bool isRandom1() const {
+        return (mode1 & 0x01) ? true : false;
+    }
+    bool isRandom2() const {
+        return (mode2 & 0x01) ? true : false;
+    }
+    // 0xRRGGBB
+    unsigned int getColor1() const {
+        return (color1[0] << 16) | (color1[1] << 8) | color1[2];
+    }
+    unsigned int getColor2() const {
+        return (color2[0] << 16) | (color2[1] << 8) | color2[2];
+    }
+    // duration in seconds
+    float getDuration() const {
+        return ticks * 0.1f;
+    }
+    static void setColor(unsigned char *color, unsigned int rgb) {
+        color[0] = (rgb >> 16) & 0xFF;
+        color[1] = (rgb >> 8) & 0xFF;
+        color[2] = (rgb >> 0) & 0xFF;
+    }
+};
+
+// Float view of a step, friendly to the ImGui widgets. Created from a
+// PackedStep for the rows being edited and packed back on change.
 struct Step {
     unsigned char mode1 = 0;
     unsigned char mode2 = 0;
@@ -92,41 +146,67 @@ struct Step {
 
     Step() {}
 
-    Step(unsigned char mode1_, unsigned int color1_, unsigned char mode2_, unsigned int color2_, unsigned int duration_) {
-        mode1 = mode1_;
-        random1 = (mode1 & 0x01) ? true : false;
-        color1[0] = (1.0f / 255.0f) * ((color1_ >> 16) & 0xFF);
-        color1[1] = (1.0f / 255.0f) * ((color1_ >> 8) & 0xFF);
-        color1[2] = (1.0f / 255.0f) * ((color1_ >> 0) & 0xFF);
-
-        mode2 = mode2_;
-        random2 = (mode2 & 0x01) ? true : false;
-        color2[0] = (1.0f / 255.0f) * ((color2_ >> 16) & 0xFF);
-        color2[1] = (1.0f / 255.0f) * ((color2_ >> 8) & 0xFF);
-        color2[2] = (1.0f / 255.0f) * ((color2_ >> 0) & 0xFF);
+    Step(const PackedStep &step) {
+        mode1 = step.mode1;
+        random1 = step.isRandom1();
+        mode2 = step.mode2;
+        random2 = step.isRandom2();
+        for (int n = 0; n < 3; n++) {
+            color1[n] = (1.0f / 255.0f) * step.color1[n];
+            color2[n] = (1.0f / 255.0f) * step.color2[n];
+        }
+        duration = step.getDuration();
+    }
 
-        // file holds value in ms, keep duration in seconds
-        duration = ((float)duration_ * 100.0f) / 1000.0f;
+    PackedStep pack() const {
+        PackedStep step;
+        step.mode1 = (mode1 & ~0x01) | (random1 ? 0x01 : 0x00);
+        step.mode2 = (mode2 & ~0x01) | (random2 ? 0x01 : 0x00);
+        for (int n = 0; n < 3; n++) {
+            step.color1[n] = packComponent(color1[n]);
+            step.color2[n] = packComponent(color2[n]);
+        }
+        float ticks = duration * 10.0f + 0.5f;
+        step.ticks = ticks < 0.0f ? 0 : (ticks > 255.0f ? 255 : (unsigned char)ticks);
+        return step;
+    }
+    static unsigned char packComponent(float v) {
+        v = v < 0.0f ? 0.0f : (v > 1.0f ? 1.0f : v);
+        return (unsigned char)(v * 255.0f + 0.5f);
     }
 };
 
 struct Sequence {
-    std::vector<Step> data;
+    std::vector<PackedStep> data;
 //    FileName fileName;
     bool valid;
     float duration;
     char shortName[32];
     char fileName[32];
+    char filePath[256];
     char description[256];
     bool running;
+    // sequences restored from the library manifest carry only the header,
+    // their steps are loaded on first use (see loadSequenceSteps())
+    bool stepsLoaded;
+    int stepCount;
+    // edited or generated since it was loaded or saved
+    bool dirty;
+    // cumulative duration index: end of step n in 100 ms ticks, kept up to
+    // date by addStep(), delStep(), setStep() and calcDuration()
+    std::vector<uint32_t> stepEnd;
 
     Sequence() {
         valid = false;
         duration = 0;
         memset(shortName, 0, 32);
         memset(fileName, 0, 32);
+        memset(filePath, 0, 256);
         memset(description, 0, 32);
         running = false;
+        stepsLoaded = true;
+        stepCount = 0;
+        dirty = false;
     }
 //    Sequence(FileName fileName_) {
 //        valid = false;
@@ -137,28 +217,52 @@ struct Sequence {
     Sequence(const char *shortName_) {
         valid = false;
         duration = 0;
+        memset(shortName, 0, 32);
         strncpy(shortName, shortName_, 31);
         memset(fileName, 0, 32);
+        memset(filePath, 0, 256);
         memset(description, 0, 32);
         running = false;
+        stepsLoaded = true;
+        stepCount = 0;
+        dirty = false;
     }
     Sequence(const char *shortName_, const char *fileName_) {
         valid = false;
         duration = 0;
+        memset(shortName, 0, 32);
+        memset(fileName, 0, 32);
         strncpy(shortName, shortName_, 31);
         strncpy(fileName, fileName_, 31);
+        memset(filePath, 0, 256);
         memset(description, 0, 32);
         running = false;
+        stepsLoaded = true;
+        stepCount = 0;
+        dirty = false;
     }
     void setShortName(const char *shortName_) {
         strncpy(shortName, shortName_, 31);
+        // make sure string is always '\0' terminated!
+        shortName[31] = '\0';
     }
     const char *getShortName() {
         return shortName;
     }
+    void setFileName(const char *fileName_) {
+        strncpy(fileName, fileName_, 31);
+        fileName[31] = '\0';
+    }
     const char *getFileName() {
         return fileName;
     }
+    void setFilePath(const char *filePath_) {
+        strncpy(filePath, filePath_, 255);
+        filePath[255] = '\0';
+    }
+    const char *getFilePath() {
+        return filePath;
+    }
     void appendDescription(const char *description_) {
         size_t n = strlen(description);
         // check for overflow
@@ -178,11 +282,30 @@ struct Sequence {
         return description;
     }
 
-    void addStep(Step s) {
+    void addStep(const PackedStep &s) {
         data.push_back(s);
+        if (stepEnd.size() + 1 == data.size()) {
+            stepEnd.push_back(endTicks() + s.ticks);
+            duration = endTicks() * 0.1f;
+        }
+    }
+    void addStep(const Step &s) {
+        addStep(s.pack());
     }
     void delStep(size_t n) {
         data.erase(data.begin()+n);
+        if (stepEnd.size() == data.size() + 1) {
+            stepEnd.erase(stepEnd.begin()+n);
+            updateIndex(n);
+        }
+    }
+    void setStep(size_t n, const PackedStep &s) {
+        assert(n < data.size());
+        unsigned char ticks = data[n].ticks;
+        data[n] = s;
+        if ((ticks != s.ticks) && (stepEnd.size() == data.size())) {
+            updateIndex(n);
+        }
     }
 //    void erase() {
 //        data.clear();
@@ -199,20 +322,63 @@ struct Sequence {
     int numSteps() {
         return data.size();
     }
-    Step *getStep(size_t n) {
+    // number of steps, also valid before the steps are loaded
+    int getStepCount() {
+        return stepsLoaded ? data.size() : stepCount;
+    }
+    PackedStep *getStep(size_t n) {
         assert(n >= 0 && n < data.size());
         return &data[n];
     }
+    // rebuild the duration index after steps were changed directly in data
     void calcDuration() {
-        float duration_ = 0;
-        for (size_t n = 0; n < data.size(); n++) {
-            duration_ += data[n].duration;
-        }
-        duration = duration_;
+        stepEnd.resize(data.size());
+        updateIndex(0);
     }
     float getDuration() {
         return duration;
     }
+    // sum the ticks from step n on, no rounding errors accumulate
+    void updateIndex(size_t n) {
+        uint32_t ticks = (n > 0) ? stepEnd[n - 1] : 0;
+        for (; n < data.size(); n++) {
+            ticks += data[n].ticks;
+            stepEnd[n] = ticks;
+        }
+        duration = ticks * 0.1f;
+    }
+    uint32_t endTicks() {
+        return stepEnd.empty() ? 0 : stepEnd.back();
+    }
+    // start of step n in seconds
+    double getStepStart(size_t n) {
+        if (stepEnd.size() != data.size())
+            calcDuration();
+        return (n > 0) ? stepEnd[n - 1] * 0.1 : 0.0;
+    }
+    // Index of the step active at time t (in seconds), -1 when t is past the
+    // end. Binary search over the duration index; hint is the index returned
+    // previously, which makes forward playback O(1).
+    int findStep(double t, int hint = -1) {
+        if (stepEnd.size() != data.size())
+            calcDuration();
+        double ticks = t * 10.0;
+        if (ticks < 0.0)
+            ticks = 0.0;
+        int count = stepEnd.size();
+        if (hint >= 0) {
+            // same step or one of the next steps
+            for (int n = hint; (n < count) && (n < hint + 2); n++) {
+                double start = (n > 0) ? stepEnd[n - 1] : 0.0;
+                if ((ticks >= start) && (ticks < stepEnd[n]))
+                    return n;
+            }
+        }
+        std::vector<uint32_t>::iterator it = std::upper_bound(stepEnd.begin(), stepEnd.end(), ticks);
+        if (it == stepEnd.end())
+            return -1;
+        return it - stepEnd.begin();
+    }
 
     void stopRun() {
         running = false;
@@ -231,11 +397,19 @@ struct Sequence {
 struct SequenceList {
     std::vector<Sequence> data;
     int selectedSequenceIndex = -1;
+    // index into data by full short name and by file name
+    std::unordered_map<std::string, int> nameIndex;
+    std::unordered_map<std::string, int> fileNameIndex;
 
     SequenceList() {
     }
     void addSequence(Sequence seq) {
-        data.push_back(seq);
+        int n = data.size();
+        // first sequence with a given name wins
+        nameIndex.emplace(seq.getShortName(), n);
+        if (seq.getFileName()[0] != '\0')
+            fileNameIndex.emplace(seq.getFileName(), n);
+        data.push_back(std::move(seq));
     }
     int count() {
         return data.size();
@@ -259,17 +433,54 @@ struct SequenceList {
             return NULL;
         return &data[selectedSequenceIndex];
     }
+    // index of the sequence with the given short name, -1 if none
+    int findByName(const char *name) {
+        std::unordered_map<std::string, int>::iterator it = nameIndex.find(name);
+        return (it != nameIndex.end()) ? it->second : -1;
+    }
+    // index of the sequence loaded from the given file, -1 if none
+    int findByFileName(const char *fileName) {
+        std::unordered_map<std::string, int>::iterator it = fileNameIndex.find(fileName);
+        return (it != fileNameIndex.end()) ? it->second : -1;
+    }
     bool exists(const char *name) {
-        for (size_t n = 0; n < data.size(); n++) {
-            if (strncmp(sequence(n)->getShortName(), name, strlen(name)) == 0) {
-                return true;
-            }
-        }
-        return false;
+        return findByName(name) != -1;
     }
 };
 
 FileList loadFileList(const char *filePath);
+// memory mapped, single pass loader; handles text and compiled sequences
 Sequence loadSequence(const FileName *fileName);
+// same, for a path of any length
+Sequence loadSequenceFile(const char *path);
+// original fgets() / sscanf() based loader, kept for reference and benchmarks
+Sequence loadSequenceStdio(const FileName *fileName);
+// write the sequence in compiled (binary) format, see seqformat.h
+bool writeSequenceBinary(Sequence *sequence, const char *path);
+// longest step of each file format in 100 ms ticks; the sketch parses 2
+// digits of the text duration field
+#define TEXT_MAX_TICKS      99
+#define BINARY_MAX_TICKS    255
+// write the sequence in text format; steps over TEXT_MAX_TICKS get a 3 digit
+// duration the sketch can not read
+bool writeSequenceText(Sequence *sequence, const char *path);
+// text or compiled, by the file name extension
+bool writeSequence(Sequence *sequence, const char *path);
+// the file contents writeSequenceBinary() or writeSequenceText() would write
+bool formatSequence(Sequence *sequence, bool compiled, std::string *out);
+// header of a compiled sequence with the given totals
+struct SeqbHeader;
+void initBinaryHeader(SeqbHeader *header, const char *name, const char *description, uint32_t numSteps, uint32_t duration);
+// load steps of a sequence that was created from its header only
+bool loadSequenceSteps(Sequence *sequence);
+// Files are written to a temp file next to path that is renamed into place
+// once complete, so a reader never sees half of one. commitTempFile() closes
+// fp, renames if ok and all writes went through, and removes the temp file
+// otherwise.
+FILE *openTempFile(const char *path, std::string *tmpPath);
+bool commitTempFile(FILE *fp, bool ok, const std::string &tmpPath, const char *path);
+// 64-bit FNV-1a hash of the file contents
+bool hashFile(const char *path, uint64_t *hash);
+uint64_t hashData(const void *data, size_t size);
 
 #endif // SEQUENCE_H
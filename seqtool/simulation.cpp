@@ -0,0 +1,183 @@
+#include <errno.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <thread>
+
+#include "simulation.h"
+
+bool simulate(Sequence *sequence, double seconds, double timeScale, SimTrace *trace)
+{
+    trace->events.clear();
+    trace->endTicks = 0;
+    strncpy(trace->name, sequence->getShortName(), SIMT_NAME_LEN - 1);
+    trace->name[SIMT_NAME_LEN - 1] = '\0';
+    int numSteps = sequence->numSteps();
+    if (sequence->stepEnd.size() != sequence->data.size())
+        sequence->calcDuration();
+    uint32_t loopTicks = sequence->endTicks();
+    if (numSteps == 0 || loopTicks == 0 || seconds <= 0 || seconds * 10 >= UINT32_MAX)
+        return false;
+    uint32_t endTicks = (uint32_t)(seconds * 10 + 0.5);
+    trace->endTicks = endTicks;
+    // every step of every loop becomes an event, allocate them once
+    uint64_t loops = endTicks / loopTicks + 1;
+    trace->events.reserve(std::min<uint64_t>(loops * numSteps, 1u << 24));
+
+    // the wall clock deadline of an event is computed from its virtual time,
+    // late wake ups do not add up
+    std::chrono::steady_clock::time_point origin = std::chrono::steady_clock::now();
+    uint32_t loopStart = 0;
+    for (unsigned int loop = 0; loopStart < endTicks; loop++) {
+        for (int n = 0; n < numSteps; n++) {
+            uint32_t ticks = loopStart + (n > 0 ? sequence->stepEnd[n - 1] : 0);
+            if (ticks >= endTicks)
+                break;
+            if (timeScale > 0) {
+                std::chrono::duration<double> t(ticks * 0.1 / timeScale);
+                std::this_thread::sleep_until(origin + std::chrono::duration_cast<std::chrono::steady_clock::duration>(t));
+            }
+            PackedStep *s = sequence->getStep(n);
+            SimEvent event;
+            event.ticks = ticks;
+            event.step = n;
+            event.loop = loop;
+            event.color1 = s->getColor1();
+            event.color2 = s->getColor2();
+            trace->events.push_back(event);
+        }
+        loopStart += loopTicks;
+    }
+    return true;
+}
+
+bool writeTrace(const char *path, const SimTrace &trace)
+{
+    SimTraceHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic[0] = SIMT_MAGIC0;
+    header.magic[1] = SIMT_MAGIC1;
+    header.magic[2] = SIMT_MAGIC2;
+    header.magic[3] = SIMT_MAGIC3;
+    header.version = SIMT_VERSION;
+    header.recordSize = sizeof(SimTraceRecord);
+    header.headerSize = sizeof(SimTraceHeader);
+    header.numRecords = trace.events.size();
+    header.endTicks = trace.endTicks;
+    memcpy(header.name, trace.name, SIMT_NAME_LEN);
+
+    std::vector<SimTraceRecord> records(trace.events.size());
+    for (size_t n = 0; n < trace.events.size(); n++) {
+        const SimEvent &event = trace.events[n];
+        records[n].ticks = event.ticks;
+        records[n].step = event.step;
+        PackedStep::setColor(records[n].color1, event.color1);
+        PackedStep::setColor(records[n].color2, event.color2);
+    }
+
+    std::string tmpPath;
+    FILE *fp = openTempFile(path, &tmpPath);
+    if (fp == NULL)
+        return false;
+    bool ok = (fwrite(&header, sizeof(header), 1, fp) == 1) &&
+              (fwrite(records.data(), sizeof(SimTraceRecord), records.size(), fp) == records.size());
+    return commitTempFile(fp, ok, tmpPath, path);
+}
+
+bool readTrace(const char *path, SimTrace *trace)
+{
+    FILE *fp = fopen(path, "rb");
+    if (fp == NULL) {
+        fprintf(stderr, "fopen() failed: %d %s\n", errno, strerror(errno));
+        return false;
+    }
+    SimTraceHeader header;
+    if ((fread(&header, sizeof(header), 1, fp) != 1) ||
+        (header.magic[0] != SIMT_MAGIC0) || (header.magic[1] != SIMT_MAGIC1) ||
+        (header.magic[2] != SIMT_MAGIC2) || (header.magic[3] != SIMT_MAGIC3) ||
+        (header.version != SIMT_VERSION) || (header.recordSize != sizeof(SimTraceRecord)) ||
+        (header.headerSize < sizeof(SimTraceHeader))) {
+        fprintf(stderr, "%s is not a trace file\n", path);
+        fclose(fp);
+        return false;
+    }
+    std::vector<SimTraceRecord> records(header.numRecords);
+    bool ok = (fseek(fp, header.headerSize, SEEK_SET) == 0) &&
+              (fread(records.data(), sizeof(SimTraceRecord), records.size(), fp) == records.size());
+    fclose(fp);
+    if (! ok) {
+        fprintf(stderr, "trace %s is truncated\n", path);
+        return false;
+    }
+
+    memcpy(trace->name, header.name, SIMT_NAME_LEN);
+    trace->name[SIMT_NAME_LEN - 1] = '\0';
+    trace->endTicks = header.endTicks;
+    trace->events.resize(records.size());
+    unsigned int loop = 0;
+    for (size_t n = 0; n < records.size(); n++) {
+        const SimTraceRecord &record = records[n];
+        // steps only go forward within a loop
+        if (n > 0 && record.step <= records[n - 1].step)
+            loop++;
+        SimEvent &event = trace->events[n];
+        event.ticks = record.ticks;
+        event.step = record.step;
+        event.loop = loop;
+        event.color1 = (record.color1[0] << 16) | (record.color1[1] << 8) | record.color1[2];
+        event.color2 = (record.color2[0] << 16) | (record.color2[1] << 8) | record.color2[2];
+    }
+    return true;
+}
+
+// sequence names come from the files, keep the JSON valid whatever they hold
+static void writeJsonString(FILE *fp, const char *s)
+{
+    fputc('"', fp);
+    for (; *s; s++) {
+        unsigned char c = *s;
+        if (c == '"' || c == '\\')
+            fprintf(fp, "\\%c", c);
+        else if (c < 0x20)
+            fprintf(fp, "\\u%04x", c);
+        else
+            fputc(c, fp);
+    }
+    fputc('"', fp);
+}
+
+bool writeChromeTrace(const char *path, const SimTrace &trace)
+{
+    FILE *fp = fopen(path, "w");
+    if (fp == NULL) {
+        fprintf(stderr, "fopen() failed: %d %s\n", errno, strerror(errno));
+        return false;
+    }
+    fprintf(fp, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    fprintf(fp, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":");
+    writeJsonString(fp, trace.name);
+    fprintf(fp, "}},\n");
+    fprintf(fp, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"panel 1\"}},\n");
+    fprintf(fp, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":2,\"args\":{\"name\":\"panel 2\"}}");
+    for (size_t n = 0; n < trace.events.size(); n++) {
+        const SimEvent &event = trace.events[n];
+        // time stamps are in microseconds
+        unsigned long long ts = event.ticks * 100000ULL;
+        unsigned long long dur = trace.eventTicks(n) * 100000ULL;
+        if (n == 0 || event.loop != trace.events[n - 1].loop)
+            fprintf(fp, ",\n{\"name\":\"loop %u\",\"cat\":\"loop\",\"ph\":\"i\",\"s\":\"p\",\"ts\":%llu,\"pid\":1,\"tid\":1}",
+                    event.loop + 1, ts);
+        // slices with the same name share a color in the viewer
+        fprintf(fp, ",\n{\"name\":\"#%06X\",\"cat\":\"step\",\"ph\":\"X\",\"ts\":%llu,\"dur\":%llu,\"pid\":1,\"tid\":1,\"args\":{\"step\":%d}}",
+                event.color1, ts, dur, event.step + 1);
+        fprintf(fp, ",\n{\"name\":\"#%06X\",\"cat\":\"step\",\"ph\":\"X\",\"ts\":%llu,\"dur\":%llu,\"pid\":1,\"tid\":2,\"args\":{\"step\":%d}}",
+                event.color2, ts, dur, event.step + 1);
+    }
+    fprintf(fp, "\n]}\n");
+    if (fclose(fp) != 0) {
+        fprintf(stderr, "failed to write %s: %d %s\n", path, errno, strerror(errno));
+        return false;
+    }
+    return true;
+}
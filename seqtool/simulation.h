@@ -0,0 +1,81 @@
+#ifndef SIMULATION_H
+#define SIMULATION_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <vector>
+
+#include "sequence.h"
+
+// Headless playback of a sequence on virtual time. Jumps from one step
+// transition to the next instead of waiting for them, optionally paced
+// against the monotonic clock at a given time scale. No GUI dependencies.
+
+// Binary event trace: SimTraceHeader followed by numRecords SimTraceRecord.
+// All fields little endian, like the compiled sequence format.
+#define SIMT_MAGIC0     'S'
+#define SIMT_MAGIC1     'Q'
+#define SIMT_MAGIC2     'T'
+#define SIMT_MAGIC3     '1'
+#define SIMT_VERSION    2
+#define SIMT_NAME_LEN   32
+
+#pragma pack(push, 1)
+struct SimTraceHeader {
+    char magic[4];
+    uint8_t version;
+    uint8_t recordSize;         // sizeof(SimTraceRecord)
+    uint16_t headerSize;        // sizeof(SimTraceHeader)
+    uint32_t numRecords;
+    uint32_t endTicks;          // simulated time, 100 ms ticks
+    char name[SIMT_NAME_LEN];   // short name of the sequence
+};
+
+struct SimTraceRecord {
+    uint32_t ticks;             // time of the step change, 100 ms ticks
+    uint32_t step;              // step index in the sequence
+    uint8_t color1[3];          // R, G, B
+    uint8_t color2[3];          // R, G, B
+};
+#pragma pack(pop)
+
+static_assert(sizeof(SimTraceHeader) == 48, "SimTraceHeader must be 48 bytes");
+static_assert(sizeof(SimTraceRecord) == 14, "SimTraceRecord must be 14 bytes");
+
+// One step change on the panels.
+struct SimEvent {
+    uint32_t ticks;             // 100 ms ticks since the start
+    int step;
+    unsigned int loop;          // number of times the sequence wrapped around
+    unsigned int color1;        // 0xRRGGBB
+    unsigned int color2;        // 0xRRGGBB
+};
+
+struct SimTrace {
+    std::vector<SimEvent> events;
+    uint32_t endTicks;
+    char name[SIMT_NAME_LEN];
+
+    SimTrace() {
+        endTicks = 0;
+        memset(name, 0, sizeof(name));
+    }
+    // time the event at index n is shown, up to the next one
+    uint32_t eventTicks(size_t n) const {
+        uint32_t end = (n + 1 < events.size()) ? events[n + 1].ticks : endTicks;
+        return end - events[n].ticks;
+    }
+};
+
+// Play the sequence for the given number of seconds and record every step
+// change. timeScale 1 runs in real time, 60 a minute per second; 0 does not
+// wait at all. Returns false for a sequence without duration.
+bool simulate(Sequence *sequence, double seconds, double timeScale, SimTrace *trace);
+
+bool writeTrace(const char *path, const SimTrace &trace);
+bool readTrace(const char *path, SimTrace *trace);
+// Chrome trace event format (chrome://tracing, Perfetto): one track per
+// panel with a slice per step, named by its color, and a mark per loop.
+bool writeChromeTrace(const char *path, const SimTrace &trace);
+
+#endif // SIMULATION_H
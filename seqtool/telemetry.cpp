@@ -0,0 +1,140 @@
+#include <errno.h>
+#include <string.h>
+#include <math.h>
+
+#include "telemetry.h"
+#include "seqformat.h"
+
+static const char *eventName(int type)
+{
+    switch (type) {
+    case SEQT_STEP: return "step";
+    case SEQT_OPEN: return "open";
+    case SEQT_REWIND: return "rewind";
+    case SEQT_UNDERRUN: return "underrun";
+    case SEQT_STOP: return "stop";
+    }
+    return "?";
+}
+
+static unsigned int packColor(const uint8_t *rgb)
+{
+    return (rgb[0] << 16) | (rgb[1] << 8) | rgb[2];
+}
+
+bool decodeTelemetry(const uint8_t *data, size_t size, TelemetryLog *log)
+{
+    bool haveTime = false;
+    uint32_t lastTime = 0;
+    int64_t ticks = 0;
+    size_t pos = 0;
+    while (pos < size) {
+        if (data[pos] != SEQT_SYNC || size - pos < sizeof(SeqtFrame)) {
+            log->textBytes++;
+            pos++;
+            continue;
+        }
+        SeqtFrame frame;
+        memcpy(&frame, data + pos, sizeof(frame));
+        uint8_t check = 0;
+        for (size_t n = 0; n < sizeof(frame) - 1; n++)
+            check ^= data[pos + n];
+        if (check != frame.check || frame.type < SEQT_STEP || frame.type > SEQT_STOP) {
+            // corrupted frame, or text written in the middle of it; look for
+            // the next sync byte
+            log->badFrames++;
+            pos++;
+            continue;
+        }
+        pos += sizeof(frame);
+
+        // the 32 bit time stamp wraps after about 19 hours
+        if (haveTime)
+            ticks += (uint32_t)(frame.time - lastTime);
+        lastTime = frame.time;
+        haveTime = true;
+
+        TelemetryEvent event;
+        event.type = frame.type;
+        event.step = frame.step;
+        event.time = ticks * SEQT_TICK_US / 1e6;
+        event.late = (double)frame.late * SEQT_TICK_US / 1e6;
+        event.color1 = packColor(frame.color1);
+        event.color2 = packColor(frame.color2);
+        event.duration = frame.duration * 0.1f;
+        log->events.push_back(event);
+    }
+    return ! log->events.empty();
+}
+
+bool readTelemetry(const char *path, TelemetryLog *log)
+{
+    FILE *fp = fopen(path, "rb");
+    if (fp == NULL) {
+        fprintf(stderr, "fopen() failed: %d %s\n", errno, strerror(errno));
+        return false;
+    }
+    std::vector<uint8_t> data;
+    uint8_t buf[4096];
+    size_t len;
+    while ((len = fread(buf, 1, sizeof(buf), fp)) > 0)
+        data.insert(data.end(), buf, buf + len);
+    fclose(fp);
+    return decodeTelemetry(data.data(), data.size(), log);
+}
+
+void printTimeline(FILE *fp, const TelemetryLog &log, bool summaryOnly)
+{
+    int numSteps = 0;
+    int numUnderruns = 0;
+    int numLoops = 0;
+    int numMissing = 0;
+    double lateMax = 0;
+    double lateSum = 0;
+    // worst difference between the time a step was shown and its duration
+    double lengthErrMax = 0;
+    const TelemetryEvent *prevStep = NULL;
+
+    for (size_t n = 0; n < log.events.size(); n++) {
+        const TelemetryEvent &event = log.events[n];
+        if (event.type == SEQT_OPEN) {
+            prevStep = NULL;
+        } else if (event.type == SEQT_REWIND) {
+            numLoops++;
+        } else if (event.type == SEQT_UNDERRUN) {
+            numUnderruns++;
+        }
+        if (event.type != SEQT_STEP) {
+            if (! summaryOnly)
+                fprintf(fp, "%12.6f  %-8s step %5d\n", event.time, eventName(event.type), event.step);
+            continue;
+        }
+
+        if (prevStep && (uint16_t)(event.step - prevStep->step) != 1) {
+            int missing = (uint16_t)(event.step - prevStep->step - 1);
+            numMissing += missing;
+            if (! summaryOnly)
+                fprintf(fp, "%12.6f  %d step frame(s) missing\n", event.time, missing);
+        } else if (prevStep) {
+            // time the previous step was actually shown
+            double length = event.time - prevStep->time;
+            double err = length - prevStep->duration;
+            if (fabs(err) > fabs(lengthErrMax))
+                lengthErrMax = err;
+        }
+        if (! summaryOnly)
+            fprintf(fp, "%12.6f  %-8s step %5d  late %8.3f ms  #%06X #%06X  %4.1f s\n",
+                    event.time, eventName(event.type), event.step, event.late * 1e3,
+                    event.color1, event.color2, event.duration);
+        numSteps++;
+        lateSum += event.late;
+        if (event.late > lateMax)
+            lateMax = event.late;
+        prevStep = &event;
+    }
+
+    fprintf(fp, "steps %d, loops %d, underruns %d, missing frames %d, bad frames %d\n",
+            numSteps, numLoops, numUnderruns, numMissing, log.badFrames);
+    fprintf(fp, "late max %.3f ms, avg %.3f ms, worst step length error %.3f ms\n",
+            lateMax * 1e3, numSteps ? lateSum / numSteps * 1e3 : 0.0, lengthErrMax * 1e3);
+}
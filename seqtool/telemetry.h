@@ -0,0 +1,40 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <vector>
+
+// One decoded telemetry frame of the sketch, see SeqtFrame in seqformat.h.
+struct TelemetryEvent {
+    int type;                   // SEQT_STEP ..
+    int step;                   // steps shown since the file was opened
+    double time;                // seconds since the first frame
+    double late;                // seconds past the step deadline
+    unsigned int color1;        // 0xRRGGBB
+    unsigned int color2;        // 0xRRGGBB
+    float duration;             // seconds
+};
+
+struct TelemetryLog {
+    std::vector<TelemetryEvent> events;
+    int badFrames;              // frames dropped for a bad check byte
+    int textBytes;              // bytes outside of frames (text messages)
+
+    TelemetryLog() {
+        badFrames = 0;
+        textBytes = 0;
+    }
+};
+
+// Decode telemetry frames from a captured Serial log, skipping the text
+// messages in between. Time stamps are unwrapped to a continuous timeline.
+bool decodeTelemetry(const uint8_t *data, size_t size, TelemetryLog *log);
+bool readTelemetry(const char *path, TelemetryLog *log);
+
+// Print the step timeline: when each step was shown, how late, and how long
+// it was actually shown compared to its duration. Gaps in the step index
+// (frames dropped by the sketch) are reported. Ends with a summary.
+void printTimeline(FILE *fp, const TelemetryLog &log, bool summaryOnly = false);
+
+#endif // TELEMETRY_H
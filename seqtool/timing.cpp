@@ -0,0 +1,153 @@
+#include <string.h>
+#include <algorithm>
+
+#include "timing.h"
+
+// bytes of a text data line "XX AAAAAA YY BBBBBB CC\n"
+#define TEXT_LINE_BYTES     23
+#define STEP_BUFFER_SIZE    4
+#define SERIAL_TX_BUFFER    64
+#define TICK_US             100000.0
+
+FirmwareModel FirmwareModel::current()
+{
+    FirmwareModel model;
+    model.name = "current";
+    model.absoluteDeadlines = true;
+    model.readAhead = true;
+    model.latchUs = 300;
+    model.ledBitUs = 1.25;
+    model.numPanels = 2;
+    model.numLeds = 64;
+    model.sdBlockUs = 1300;
+    model.sdReadUs = 60;
+    model.sdCharUs = 8;
+    // telemetry frames do not wait for the transmit buffer
+    model.serialChars = 0;
+    model.serialCharUs = 1e6 * 10 / 115200;
+    // woken up by the timer 1 compare match, 16 us ticks
+    model.pollUs = 16;
+    model.wakeUs = 40;
+    return model;
+}
+
+FirmwareModel FirmwareModel::legacy()
+{
+    FirmwareModel model = current();
+    model.name = "legacy";
+    model.absoluteDeadlines = false;
+    model.readAhead = false;
+    // ">line", mode / color and delay lines
+    model.serialChars = 93;
+    model.pollUs = 10000;
+    model.wakeUs = 100;
+    return model;
+}
+
+// time to read one step from the SD card
+static double readUs(const FirmwareModel &model, bool compiled)
+{
+    if (compiled)
+        return model.sdReadUs + model.sdBlockUs * sizeof(PackedStep) / 512;
+    return model.sdReadUs + TEXT_LINE_BYTES * model.sdCharUs + model.sdBlockUs * TEXT_LINE_BYTES / 512;
+}
+
+// extra time at the end of the file: seek back and, for text files, skip
+// the name and description lines again
+static double rewindUs(Sequence *sequence, const FirmwareModel &model, bool compiled)
+{
+    if (compiled)
+        return model.sdReadUs + model.sdBlockUs;
+    size_t headerBytes = strlen(sequence->getShortName()) + strlen(sequence->getDescription()) + 4;
+    return model.sdReadUs + model.sdBlockUs + headerBytes * model.sdCharUs;
+}
+
+TimingPrediction predictTiming(Sequence *sequence, const FirmwareModel &model, bool compiled)
+{
+    TimingPrediction prediction;
+    prediction.nominalLoop = 0;
+    prediction.actualLoop = 0;
+    prediction.driftPerLoop = 0;
+    prediction.maxLate = 0;
+    prediction.numFlagged = 0;
+    int numSteps = sequence->numSteps();
+    if (numSteps == 0)
+        return prediction;
+
+    std::vector<double> duration(numSteps);
+    for (int n = 0; n < numSteps; n++) {
+        int ticks = sequence->getStep(n)->ticks;
+        if (! compiled && ticks > TEXT_MAX_TICKS)
+            ticks /= 10;
+        duration[n] = ticks * TICK_US;
+        prediction.nominalLoop += sequence->getStep(n)->ticks * TICK_US;
+    }
+    double render = model.renderUs();
+    double read = readUs(model, compiled);
+    double rewind = rewindUs(sequence, model, compiled);
+    double serial = std::max(0, model.serialChars - SERIAL_TX_BUFFER) * model.serialCharUs;
+
+    // Walk three loops; the second one is reported, it starts with the end
+    // of file handling and is not affected by the buffer being filled at the
+    // start. shown[k] is when step k is on the panels (end of render()).
+    int total = 3 * numSteps + 1;
+    std::vector<double> shown(total);
+    std::vector<double> ready(total, 0);
+    std::vector<char> late(total, 0);
+    double deadline = 0;
+    double lastRender = -model.latchUs;
+    for (int k = 0; k < total; k++) {
+        int n = k % numSteps;
+        double readCost = read + ((n == 0 && k > 0) ? rewind : 0);
+        double start;
+        if (model.readAhead) {
+            // the slot of the step is free once the step STEP_BUFFER_SIZE
+            // before it was taken, the buffer is full at the start
+            if (k >= STEP_BUFFER_SIZE)
+                ready[k] = std::max(ready[k - 1], shown[k - STEP_BUFFER_SIZE]) + readCost;
+            start = deadline + model.wakeUs;
+            if (ready[k] > start) {
+                start = ready[k];
+                late[k] = 1;
+            }
+        } else {
+            // the previous step waits in polling periods, then this one is
+            // read and printed
+            start = deadline + (k > 0 && duration[(k - 1) % numSteps] > 0 ? model.pollUs / 2 : 0) + model.wakeUs;
+            start += readCost + serial;
+        }
+        // render() waits for the latch time since the previous one
+        start = std::max(start, lastRender + model.latchUs);
+        shown[k] = start + render;
+        lastRender = shown[k];
+        // next deadline, absolute or from the time this step was shown
+        deadline = (model.absoluteDeadlines ? deadline : shown[k]) + duration[n];
+    }
+
+    // shortest step the sketch can show: one step worth of its work
+    double minStep = render + (model.readAhead ? 0 : read + serial);
+    double origin = shown[numSteps];
+    double nominalStart = 0;
+    for (int n = 0; n < numSteps; n++) {
+        int k = numSteps + n;
+        StepTiming timing;
+        timing.start = shown[k] - origin;
+        timing.length = shown[k + 1] - shown[k];
+        timing.error = timing.length - sequence->getStep(n)->ticks * TICK_US;
+        timing.flags = 0;
+        if (sequence->getStep(n)->ticks * TICK_US < minStep)
+            timing.flags |= STEP_TIMING_TOO_SHORT;
+        if (! compiled && sequence->getStep(n)->ticks > TEXT_MAX_TICKS)
+            timing.flags |= STEP_TIMING_TRUNCATED;
+        if (late[k])
+            timing.flags |= STEP_TIMING_LATE;
+        if (timing.flags)
+            prediction.numFlagged++;
+        prediction.maxLate = std::max(prediction.maxLate, timing.start - nominalStart);
+        nominalStart += sequence->getStep(n)->ticks * TICK_US;
+        prediction.steps.push_back(timing);
+    }
+    prediction.actualLoop = shown[2 * numSteps] - origin;
+    prediction.driftPerLoop = prediction.actualLoop - prediction.nominalLoop;
+    return prediction;
+}
@@ -0,0 +1,79 @@
+#ifndef TIMING_H
+#define TIMING_H
+
+#include <vector>
+
+#include "sequence.h"
+
+// Timing model of the panel lights sketch. Predicts when the steps of a
+// sequence actually show on the panels, given the costs the firmware adds
+// on each step. All times are in microseconds.
+struct FirmwareModel {
+    const char *name;
+    // steps are scheduled against absolute deadlines (deadline += duration)
+    // instead of relative to the time the previous step was shown
+    bool absoluteDeadlines;
+    // steps are read ahead while the previous one is shown
+    bool readAhead;
+    // render(): data latch wait and WS281X bits with interrupts disabled
+    double latchUs;
+    double ledBitUs;
+    int numPanels;
+    int numLeds;
+    // SD card: 512 byte block load, one read() call, one character of a
+    // text line read with readBytesUntil()
+    double sdBlockUs;
+    double sdReadUs;
+    double sdCharUs;
+    // Serial text printed per step and what a character costs once the
+    // 64 byte transmit buffer is full
+    int serialChars;
+    double serialCharUs;
+    // polling period of the wait for the step to end; a step ends on
+    // average half a period late
+    double pollUs;
+    // latency from the deadline to the step being processed
+    double wakeUs;
+
+    // sketch with the read-ahead buffer and Timer 1 deadlines
+    static FirmwareModel current();
+    // original sketch: reads and prints each line at the step change and
+    // waits for millis() in delay(10) steps
+    static FirmwareModel legacy();
+
+    double renderUs() const {
+        return numPanels * numLeds * 24 * ledBitUs;
+    }
+};
+
+enum {
+    STEP_TIMING_TOO_SHORT = 0x01,   // shorter than the sketch can show
+    STEP_TIMING_TRUNCATED = 0x02,   // text line duration over 2 digits
+    STEP_TIMING_LATE = 0x04,        // starts later than the sketch work
+};
+
+struct StepTiming {
+    double start;                   // predicted start, from loop start
+    double length;                  // predicted time on the panels
+    double error;                   // length - nominal length
+    int flags;
+};
+
+struct TimingPrediction {
+    std::vector<StepTiming> steps;
+    double nominalLoop;             // sum of the step durations
+    double actualLoop;              // predicted time of one loop
+    double driftPerLoop;            // actualLoop - nominalLoop
+    double maxLate;                 // largest step start error
+    int numFlagged;
+
+    double driftPerHour() const {
+        return nominalLoop > 0 ? driftPerLoop * (3600e6 / nominalLoop) : 0;
+    }
+};
+
+// Predict the on-panel schedule of one loop of the sequence; compiled is
+// true when the sketch reads it from a .sqb file.
+TimingPrediction predictTiming(Sequence *sequence, const FirmwareModel &model, bool compiled);
+
+#endif // TIMING_H